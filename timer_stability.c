@@ -2,12 +2,13 @@
  * Test stability of timer frequency.
  *
  * To compile:
- *	gcc -O2 -o timer_stability timer_stability.c  -lrt -lm
+ *	gcc -O2 -o timer_stability timer_stability.c  -lrt -lm -lpthread
  *
  * To run:
  *	timer_stability ==> Will print usage.
  *
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,260 +23,6332 @@
 #include <math.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/prctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#include <linux/perf_event.h>
+#include <linux/futex.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define HAVE_TSC	1
+#define HAVE_AVX	1
+#endif
 
 #define MYSIG	(SIGRTMAX - 2)
 
-#define DFLT_ITERS	1000
+/* Older glibc doesn't name the SIGEV_THREAD_ID target. */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id	_sigev_un._tid
+#endif
+
+#define DFLT_ITERS	1000
+
+#define DFLT_TIMERFREQ	10000	/* us */
+
+#define DFLT_IO_BS	16384
+#define DFLT_IO_COUNT	20000
+#define DFLT_IO_WAIT	4	/* seconds */
+
+static ssize_t
+preadn(int fd, void *buf, size_t count, off_t off)
+{
+	ssize_t r;
+	size_t toread;
+
+	toread = count;
+	while (toread > 0) {
+		r = pread(fd, buf + (count - toread), toread,
+		    off + (count - toread));
+		if (r <= 0)
+			return r < 0 && toread == count ? r : count - toread;
+
+		toread -= r;
+	}
+
+	return count;
+}
+
+static ssize_t
+pwriten(int fd, void *buf, size_t count, off_t off)
+{
+	ssize_t r;
+	size_t towrite;
+
+	towrite = count;
+	while (towrite > 0) {
+		r = pwrite(fd, buf + (count - towrite), towrite,
+		    off + (count - towrite));
+		if (r <= 0)
+			return r < 0 && towrite == count ? r :
+			    count - towrite;
+
+		towrite -= r;
+	}
+
+	return count;
+}
+
+static int
+write_fd(int fd, const char *fmt, ...)
+{
+	va_list ap;
+	char buf[4096];
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	/* Assumes O_APPEND, so don't do pwriten(). */
+	write(fd, buf, strlen(buf));
+
+	return ret;
+}
+
+/*
+ * Clock sources selectable with --clock. All of them return nanoseconds.
+ * The TSC source is converted with a multiplier calibrated against
+ * CLOCK_MONOTONIC_RAW at startup and is only offered when the CPU
+ * advertises an invariant TSC.
+ */
+enum {
+	CLK_MONOTONIC,
+	CLK_MONOTONIC_RAW,
+	CLK_BOOTTIME,
+	CLK_TSC,
+	NUM_CLK,
+};
+
+static const struct {
+	const char	*name;
+	clockid_t	id;
+	clockid_t	timer_id;	/* Closest clock timer_create() takes. */
+} clock_srcs[NUM_CLK] = {
+	[CLK_MONOTONIC]		= { "monotonic", CLOCK_MONOTONIC,
+				    CLOCK_MONOTONIC },
+	[CLK_MONOTONIC_RAW]	= { "raw", CLOCK_MONOTONIC_RAW,
+				    CLOCK_MONOTONIC },
+	[CLK_BOOTTIME]		= { "boottime", CLOCK_BOOTTIME,
+				    CLOCK_BOOTTIME },
+	[CLK_TSC]		= { "tsc", CLOCK_MONOTONIC_RAW,
+				    CLOCK_MONOTONIC },
+};
+
+static int clock_src = CLK_MONOTONIC;
+static uint64_t clock_overhead;		/* ns per read of clock_src */
+
+#ifdef HAVE_TSC
+static uint64_t tsc_base, tsc_base_ns, tsc_mult;	/* mult is ns << 32 */
+static int tsc_usable;
+#endif
+
+static inline uint64_t
+clock_read(int src)
+{
+	struct timespec tv;
+
+#ifdef HAVE_TSC
+	if (src == CLK_TSC)
+		return tsc_base_ns + (uint64_t)(((unsigned __int128)
+		    (__rdtsc() - tsc_base) * tsc_mult) >> 32);
+#endif
+
+	clock_gettime(clock_srcs[src].id, &tv);
+
+	return (uint64_t)tv.tv_sec * 1000000000ULL + tv.tv_nsec;
+}
+
+static inline uint64_t
+get_time(void)
+{
+
+	return clock_read(clock_src);
+}
+
+#ifdef HAVE_TSC
+/* Work out the TSC frequency. Returns 0 if the TSC is usable. */
+static int
+tsc_calibrate(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	struct timespec ts = { 0, 100000000 };
+	uint64_t ns_end, tsc_end;
+
+	/* Invariant TSC: CPUID.80000007H:EDX[8]. */
+	if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 ||
+	    (edx & (1 << 8)) == 0)
+		return 1;
+
+	tsc_base_ns = clock_read(CLK_MONOTONIC_RAW);
+	tsc_base = __rdtsc();
+	nanosleep(&ts, NULL);
+	ns_end = clock_read(CLK_MONOTONIC_RAW);
+	tsc_end = __rdtsc();
+
+	if (tsc_end <= tsc_base)
+		return 1;
+
+	tsc_mult = ((ns_end - tsc_base_ns) << 32) / (tsc_end - tsc_base);
+	tsc_usable = 1;
+
+	return 0;
+}
+#endif
+
+/* Average cost of one read of src, best of a few rounds. */
+static uint64_t
+clock_read_overhead(int src)
+{
+	uint64_t start, end, best;
+	int round, i;
+
+	best = UINT64_MAX;
+	for (round = 0; round < 5; round++) {
+		start = clock_read(src);
+		for (i = 0; i < 10000; i++)
+			clock_read(src);
+		end = clock_read(src);
+
+		if ((end - start) / 10001 < best)
+			best = (end - start) / 10001;
+	}
+
+	return best;
+}
+
+/*
+ * Calibrate the TSC if present and report what each clock source costs to
+ * read. The overhead of the selected source is subtracted from gaps.
+ */
+static void
+clock_calibrate(void)
+{
+	int src;
+
+#ifdef HAVE_TSC
+	tsc_calibrate();
+	if (clock_src == CLK_TSC && !tsc_usable) {
+		fprintf(stderr, "No invariant TSC on this CPU\n");
+		exit(1);
+	}
+#endif
+
+	printf("Clock read overhead:");
+	for (src = 0; src < NUM_CLK; src++) {
+		uint64_t ovh;
+
+#ifdef HAVE_TSC
+		if (src == CLK_TSC && !tsc_usable) {
+			printf(" %s: n/a", clock_srcs[src].name);
+			continue;
+		}
+#else
+		if (src == CLK_TSC)
+			continue;
+#endif
+		ovh = clock_read_overhead(src);
+		if (src == clock_src)
+			clock_overhead = ovh;
+
+		printf(" %s: %" PRIu64 " ns%s", clock_srcs[src].name, ovh,
+		    src == clock_src ? " (selected)" : "");
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+#define NS_TO_US(ns)	((double)(ns) / 1000.0)
+
+static uint64_t prog_start;
+static int iters, timerfreq, yieldtime, yieldpct, tcsv_fd, icsv_fd, acsv_fd;
+static int mcsv_fd = -1, kcsv_fd = -1, ncsv_fd = -1;
+static int use_busyloop, use_threads;
+
+/* Tick delivery backends, see tick_backends[]. */
+enum {
+	TICK_SIGNAL,
+	TICK_SLEEP,
+	TICK_ABS_SLEEP,
+	TICK_TIMERFD,
+	TICK_TIMERFD_EPOLL,
+	TICK_FUTEX,		/* The rest are --wakeup-test ping-pongs. */
+	TICK_EVENTFD,
+	TICK_PIPE,
+	TICK_UNIX,
+	TICK_CONDVAR,
+	NUM_TICK,
+};
+#define TICK_IS_WAKEUP(b)	((b) >= TICK_FUTEX)
+
+struct timer_state;
+struct trace;
+
+struct tick_backend {
+	const char	*name;
+	int		(*run)(struct timer_state *);
+};
+
+static const struct tick_backend tick_backends[NUM_TICK];
+
+/* Timer n uses backends[n % nbackends]. */
+static int backends[NUM_TICK], nbackends;
+static const char *hist_dump, *csv_prefix;
+static int aggregate;
+static volatile sig_atomic_t stop_requested;
+
+/*
+ * Log-linear (HDR style) histogram. Values below HIST_SUB_COUNT are
+ * recorded exactly; above that each power-of-two range is split into
+ * HIST_SUB_HALF linear sub-buckets, so the relative error of any
+ * reported value is at most 1 / HIST_SUB_HALF. Values of 2^HIST_MAX_BITS
+ * and above are clamped into the last bucket.
+ *
+ * Memory is fixed and recording is O(1) with no allocation, so it is
+ * safe to use from the timer signal handler.
+ */
+#define HIST_SUB_BITS	8
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+#define HIST_SUB_HALF	(HIST_SUB_COUNT / 2)
+#define HIST_MAX_BITS	40
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 2) * HIST_SUB_HALF)
+
+struct hist {
+	uint64_t	total;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	counts[HIST_BUCKETS];
+};
+
+/* Percentiles shown on every report line and CSV row. */
+static const double report_pcts[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+#define NUM_REPORT_PCTS	(sizeof(report_pcts) / sizeof(report_pcts[0]))
+
+static inline unsigned
+hist_index(uint64_t v)
+{
+	unsigned shift;
+
+	if (v < HIST_SUB_COUNT)
+		return v;
+	if (v >= (1ULL << HIST_MAX_BITS))
+		v = (1ULL << HIST_MAX_BITS) - 1;
+
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+
+	return shift * HIST_SUB_HALF + (v >> shift);
+}
+
+/* Lowest value that maps to bucket idx. */
+static inline uint64_t
+hist_bucket_lo(unsigned idx)
+{
+	unsigned shift;
+
+	if (idx < HIST_SUB_COUNT)
+		return idx;
+
+	shift = idx / HIST_SUB_HALF - 1;
+
+	return (uint64_t)(idx - shift * HIST_SUB_HALF) << shift;
+}
+
+/* Highest value that maps to bucket idx. */
+static inline uint64_t
+hist_bucket_hi(unsigned idx)
+{
+	unsigned shift;
+
+	if (idx < HIST_SUB_COUNT)
+		return idx;
+
+	shift = idx / HIST_SUB_HALF - 1;
+
+	return hist_bucket_lo(idx) + (1ULL << shift) - 1;
+}
+
+static inline void
+hist_reset(struct hist *h)
+{
+
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+static inline void
+hist_record(struct hist *h, uint64_t v)
+{
+
+	h->counts[hist_index(v)]++;
+	h->total++;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void
+hist_merge(struct hist *dst, const struct hist *src)
+{
+	unsigned idx;
+
+	for (idx = 0; idx < HIST_BUCKETS; idx++)
+		dst->counts[idx] += src->counts[idx];
+	dst->total += src->total;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+/*
+ * Merge the counts cur gained over prev into dst. The extremes of the
+ * delta are only known to bucket precision.
+ */
+static void
+hist_merge_delta(struct hist *dst, const struct hist *cur,
+    const struct hist *prev)
+{
+	uint64_t d;
+	unsigned idx;
+
+	for (idx = 0; idx < HIST_BUCKETS; idx++) {
+		if (cur->counts[idx] <= prev->counts[idx])
+			continue;
+
+		d = cur->counts[idx] - prev->counts[idx];
+		dst->counts[idx] += d;
+		dst->total += d;
+		if (hist_bucket_lo(idx) < dst->min)
+			dst->min = hist_bucket_lo(idx);
+		if (hist_bucket_hi(idx) > dst->max)
+			dst->max = hist_bucket_hi(idx) < cur->max ?
+			    hist_bucket_hi(idx) : cur->max;
+	}
+}
+
+/*
+ * Fill out[i] with the value at percentile pcts[i]. The percentiles
+ * must be sorted ascending. Reported values are the highest value
+ * equivalent to the bucket, capped at the recorded maximum.
+ */
+static void
+hist_percentiles(const struct hist *h, const double *pcts, int npcts,
+    uint64_t *out)
+{
+	uint64_t seen, want;
+	unsigned idx;
+	int p;
+
+	if (h->total == 0) {
+		for (p = 0; p < npcts; p++)
+			out[p] = 0;
+		return;
+	}
+
+	seen = 0;
+	idx = 0;
+	for (p = 0; p < npcts; p++) {
+		want = (uint64_t)ceil(pcts[p] / 100.0 * (double)h->total);
+		if (want == 0)
+			want = 1;
+
+		while (idx < HIST_BUCKETS && seen + h->counts[idx] < want)
+			seen += h->counts[idx++];
+
+		if (idx == HIST_BUCKETS)
+			out[p] = h->max;
+		else
+			out[p] = hist_bucket_hi(idx) > h->max ? h->max :
+			    hist_bucket_hi(idx);
+	}
+}
+
+/*
+ * Write every non-empty bucket as "lo,hi,count". The bucket layout is
+ * fixed, so dumps from separate runs can be merged by summing counts.
+ */
+static int
+hist_dump_file(const struct hist *h, const char *path, int index,
+    const char *unit)
+{
+	FILE *fp;
+	unsigned idx;
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		fprintf(stderr, "Failed to open: %s\n", path);
+		return 1;
+	}
+
+	fprintf(fp, "# timer_stability histogram\n");
+	fprintf(fp, "# pid %d proc %d unit %s sub_bits %d total %" PRIu64
+	    " min %" PRIu64 " max %" PRIu64 "\n", getpid(), index, unit,
+	    HIST_SUB_BITS, h->total, h->total ? h->min : 0, h->max);
+	fprintf(fp, "lo,hi,count\n");
+	for (idx = 0; idx < HIST_BUCKETS; idx++) {
+		if (h->counts[idx] == 0)
+			continue;
+		fprintf(fp, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+		    hist_bucket_lo(idx), hist_bucket_hi(idx), h->counts[idx]);
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+struct cpu_stat {
+	uint64_t	user;
+	uint64_t	lowp;
+	uint64_t	sys;
+	uint64_t	idle;
+	uint64_t	iowait;
+	uint64_t	irq;
+	uint64_t	softirq;
+	uint64_t	steal;
+};
+
+static inline uint64_t
+total_proc_stat_time(struct cpu_stat *cpu)
+{
+
+	return cpu->user + cpu->lowp + cpu->sys + cpu->idle +
+	    cpu->iowait + cpu->irq + cpu->softirq + cpu->steal;
+}
+
+/*
+ * /proc sampler. Each timer keeps its /proc files open and re-reads
+ * them with pread() into one buffer that only grows, then parses them
+ * by hand: no stdio and no allocation per sample. A sample holds the
+ * /proc/stat times, interrupt and softirq counts of one CPU (or of all
+ * of them if the CPU is unknown) and the timer thread's schedstat.
+ */
+enum {
+	PROC_STAT,
+	PROC_SOFTIRQS,
+	PROC_INTERRUPTS,
+	PROC_SCHEDSTAT,
+	NUM_PROC_FILES,
+};
+
+static const char *proc_files[NUM_PROC_FILES] = {
+	[PROC_STAT]		= "/proc/stat",
+	[PROC_SOFTIRQS]		= "/proc/softirqs",
+	[PROC_INTERRUPTS]	= "/proc/interrupts",
+	[PROC_SCHEDSTAT]	= "/proc/thread-self/schedstat",
+};
+
+struct proc_sampler {
+	int		fds[NUM_PROC_FILES];	/* -1 if unavailable. */
+	char		*buf;
+	size_t		size;
+};
+
+struct proc_sample {
+	int		cpu;		/* -1: system wide. */
+	struct cpu_stat	stat;		/* USER_HZ ticks. */
+	uint64_t	irqs;
+	uint64_t	softirqs;
+	uint64_t	run_ns;		/* Time the thread ran. */
+	uint64_t	wait_ns;	/* Time it sat runnable on a queue. */
+};
+
+static void
+proc_sampler_open(struct proc_sampler *ps)
+{
+	int i;
+
+	for (i = 0; i < NUM_PROC_FILES; i++)
+		ps->fds[i] = open(proc_files[i], O_RDONLY|O_CLOEXEC);
+
+	ps->size = 65536;
+	ps->buf = malloc(ps->size);
+	if (ps->buf == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+}
+
+static void
+proc_sampler_close(struct proc_sampler *ps)
+{
+	int i;
+
+	for (i = 0; i < NUM_PROC_FILES; i++) {
+		if (ps->fds[i] != -1)
+			close(ps->fds[i]);
+		ps->fds[i] = -1;
+	}
+	free(ps->buf);
+	ps->buf = NULL;
+}
+
+/* Read one whole file into ps->buf, NUL terminated. */
+static int
+proc_read(struct proc_sampler *ps, int file)
+{
+	ssize_t n;
+	char *nbuf;
+
+	if (ps->fds[file] == -1)
+		return -1;
+
+	while ((n = pread(ps->fds[file], ps->buf, ps->size - 1, 0)) ==
+	    (ssize_t)ps->size - 1) {
+		nbuf = realloc(ps->buf, ps->size * 2);
+		if (nbuf == NULL)
+			return -1;
+		ps->buf = nbuf;
+		ps->size *= 2;
+	}
+	if (n < 0)
+		return -1;
+	ps->buf[n] = '\0';
+
+	return 0;
+}
+
+/* Parse an unsigned number after blanks. *pp only moves on success. */
+static inline int
+proc_u64(const char **pp, uint64_t *v)
+{
+	const char *p = *pp;
+
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (*p < '0' || *p > '9')
+		return -1;
+
+	*v = 0;
+	while (*p >= '0' && *p <= '9')
+		*v = *v * 10 + (*p++ - '0');
+	*pp = p;
+
+	return 0;
+}
+
+static inline const char *
+proc_next_line(const char *p)
+{
+
+	p = strchr(p, '\n');
+	return p == NULL ? NULL : p + 1;
+}
+
+/* The "cpu " or "cpuN " line of /proc/stat. */
+static int
+proc_parse_stat(const char *buf, int cpu, struct cpu_stat *st)
+{
+	uint64_t *f[] = { &st->user, &st->lowp, &st->sys, &st->idle,
+	    &st->iowait, &st->irq, &st->softirq, &st->steal };
+	char key[16];
+	const char *p;
+	size_t klen;
+	unsigned i;
+
+	if (cpu < 0)
+		klen = snprintf(key, sizeof(key), "cpu ");
+	else
+		klen = snprintf(key, sizeof(key), "cpu%d ", cpu);
+
+	for (p = buf; p != NULL; p = proc_next_line(p))
+		if (strncmp(p, key, klen) == 0)
+			break;
+	if (p == NULL)
+		return -1;
+
+	p += klen;
+	for (i = 0; i < sizeof(f) / sizeof(f[0]); i++)
+		if (proc_u64(&p, f[i]) != 0)
+			return -1;
+
+	return 0;
+}
+
+/*
+ * Sum column "CPU<cpu>" of a /proc/softirqs or /proc/interrupts style
+ * table over every row, or all columns if cpu is -1.
+ */
+static int
+proc_sum_column(const char *buf, int cpu, uint64_t *sum)
+{
+	const char *p, *q;
+	char key[16];
+	uint64_t v;
+	int col, ncols, i;
+	size_t klen;
+
+	/* Find the column in the "CPU0 CPU1 ..." header. */
+	klen = snprintf(key, sizeof(key), "CPU%d", cpu);
+	col = -1;
+	ncols = 0;
+	for (p = buf; *p != '\n' && *p != '\0'; ) {
+		while (*p == ' ')
+			p++;
+		if (*p == '\n' || *p == '\0')
+			break;
+		if (strncmp(p, key, klen) == 0 &&
+		    (p[klen] == ' ' || p[klen] == '\n'))
+			col = ncols;
+		ncols++;
+		while (*p != ' ' && *p != '\n' && *p != '\0')
+			p++;
+	}
+	if (cpu >= 0 && col == -1)
+		return -1;
+
+	*sum = 0;
+	for (p = proc_next_line(buf); p != NULL; p = proc_next_line(p)) {
+		q = strchr(p, ':');
+		if (q == NULL)
+			break;
+		q++;
+		for (i = 0; i < ncols && proc_u64(&q, &v) == 0; i++)
+			if (cpu < 0 || i == col)
+				*sum += v;
+	}
+
+	return 0;
+}
+
+/* Take a sample for cpu. Returns -1 if /proc/stat can't be used. */
+static int
+proc_sample(struct proc_sampler *ps, int cpu, struct proc_sample *s)
+{
+	const char *p;
+
+	s->cpu = cpu;
+	if (proc_read(ps, PROC_STAT) != 0 ||
+	    proc_parse_stat(ps->buf, cpu, &s->stat) != 0) {
+		s->cpu = -1;
+		if (cpu < 0 || proc_parse_stat(ps->buf, -1, &s->stat) != 0)
+			return -1;
+	}
+
+	s->softirqs = s->irqs = 0;
+	if (proc_read(ps, PROC_SOFTIRQS) == 0)
+		proc_sum_column(ps->buf, s->cpu, &s->softirqs);
+	if (proc_read(ps, PROC_INTERRUPTS) == 0)
+		proc_sum_column(ps->buf, s->cpu, &s->irqs);
+
+	s->run_ns = s->wait_ns = 0;
+	if (proc_read(ps, PROC_SCHEDSTAT) == 0) {
+		p = ps->buf;
+		if (proc_u64(&p, &s->run_ns) != 0 ||
+		    proc_u64(&p, &s->wait_ns) != 0)
+			s->run_ns = s->wait_ns = 0;
+	}
+
+	return 0;
+}
+
+
+static inline void
+ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+
+	ts->tv_sec = ns / 1000000000ULL;
+	ts->tv_nsec = ns % 1000000000ULL;
+}
+
+/* Timer scheduling and memory settings, see rt_apply(). */
+#define PREFAULT_STACK	(256 << 10)
+#define DFLT_SCHED_PRIO	50
+
+static const struct sched_policy {
+	const char	*name;
+	int		policy;
+} sched_policies[] = {
+	{ "other", SCHED_OTHER },
+	{ "fifo", SCHED_FIFO },
+	{ "rr", SCHED_RR },
+	{ "deadline", SCHED_DEADLINE },
+};
+#define NUM_SCHED_POLICIES	\
+	(sizeof(sched_policies) / sizeof(sched_policies[0]))
+
+/* Kernel ABI of sched_setattr(2), which glibc may not wrap. */
+struct dl_sched_attr {
+	uint32_t	size;
+	uint32_t	sched_policy;
+	uint64_t	sched_flags;
+	int32_t		sched_nice;
+	uint32_t	sched_priority;
+	uint64_t	sched_runtime;	/* ns */
+	uint64_t	sched_deadline;
+	uint64_t	sched_period;
+};
+
+static int sched_pol;			/* Index into sched_policies[]. */
+static int sched_prio = DFLT_SCHED_PRIO;
+static int sched_runtime;		/* us, 0: a quarter of the period. */
+static int use_mlockall, use_prefault;
+static int dma_latency = -1;		/* us, -1 if not requested. */
+
+/*
+ * CPU interference kernels for --cpu-load. They replace the empty spin
+ * of the signal backend's work loop: the loop runs one short chunk of
+ * the kernel between tick drains, and each chunk returns the work it
+ * did so every report can show the kernel's throughput next to the
+ * jitter it caused. Buffers are allocated by the timer itself after it
+ * is pinned, so they are local to its CPU.
+ */
+enum {
+	LOAD_STREAM,
+	LOAD_CHASE,
+	LOAD_AVX2,
+	LOAD_AVX512,
+	LOAD_LOCK,
+	NUM_LOAD,
+};
+
+#define DFLT_LOAD_SIZE	(64 << 20)	/* Working set, bytes. */
+#define LOAD_STREAM_CHUNK	4096	/* Elements per array per chunk. */
+#define LOAD_CHASE_CHUNK	1024	/* Loads per chunk. */
+#define LOAD_AVX_CHUNK		1024	/* FMA rounds per chunk. */
+#define LOAD_LOCK_CHUNK		256	/* Acquisitions per chunk. */
+
+struct chase_node {
+	struct chase_node	*next;
+	char			pad[64 - sizeof(void *)];
+};
+
+struct cpu_load {
+	double		*a, *b, *c;	/* stream */
+	size_t		n, pos;
+	struct chase_node *nodes, *p;	/* chase */
+	double		sink;		/* Keeps results alive. */
+	uint64_t	units;		/* Work done so far. */
+	uint64_t	start_units, start_time;	/* At interval start. */
+};
+
+/* Shared by every timer so they contend; mapped before the fork. */
+struct load_lock {
+	pthread_mutex_t	mtx;
+	uint64_t	counter;
+};
+
+struct load_kernel {
+	const char	*name;
+	const char	*unit;		/* Reported rate unit. */
+	double		scale;		/* Units per reported unit. */
+	void		(*init)(struct cpu_load *);
+	uint64_t	(*run)(struct cpu_load *);
+};
+
+static int cpu_load = -1;		/* LOAD_*, -1 if off. */
+static size_t cpu_load_size = DFLT_LOAD_SIZE;
+static struct load_lock *load_lock;
+
+static const struct load_kernel load_kernels[NUM_LOAD];
+
+static void *
+load_alloc(size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, 4096, size) != 0) {
+		fprintf(stderr, "Failed to allocate %zu bytes of load\n", size);
+		exit(1);
+	}
+
+	return p;
+}
+
+/* STREAM triad, a = b + s * c; counts 24 bytes moved per element. */
+static void
+load_stream_init(struct cpu_load *l)
+{
+	size_t i;
+
+	l->n = cpu_load_size / 3 / sizeof(double);
+	if (l->n < LOAD_STREAM_CHUNK)
+		l->n = LOAD_STREAM_CHUNK;
+	l->n -= l->n % LOAD_STREAM_CHUNK;
+	l->a = load_alloc(l->n * sizeof(double));
+	l->b = load_alloc(l->n * sizeof(double));
+	l->c = load_alloc(l->n * sizeof(double));
+	for (i = 0; i < l->n; i++) {
+		l->a[i] = 0.0;
+		l->b[i] = 1.0;
+		l->c[i] = 2.0;
+	}
+}
+
+static uint64_t
+load_stream_run(struct cpu_load *l)
+{
+	double *a, *b, *c;
+	size_t i;
+
+	a = l->a + l->pos;
+	b = l->b + l->pos;
+	c = l->c + l->pos;
+	for (i = 0; i < LOAD_STREAM_CHUNK; i++)
+		a[i] = b[i] + 3.0 * c[i];
+
+	l->pos += LOAD_STREAM_CHUNK;
+	if (l->pos == l->n)
+		l->pos = 0;
+
+	return LOAD_STREAM_CHUNK * 3 * sizeof(double);
+}
+
+/*
+ * Pointer chase through one cache line per node, linked in a random
+ * cycle so the prefetchers can't follow.
+ */
+static void
+load_chase_init(struct cpu_load *l)
+{
+	size_t i, j, n, *perm, t;
+
+	n = cpu_load_size / sizeof(struct chase_node);
+	if (n < 2)
+		n = 2;
+	l->nodes = load_alloc(n * sizeof(struct chase_node));
+
+	perm = malloc(n * sizeof(*perm));
+	if (perm == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++)
+		perm[i] = i;
+	for (i = n - 1; i > 0; i--) {
+		j = (size_t)random() % (i + 1);
+		t = perm[i];
+		perm[i] = perm[j];
+		perm[j] = t;
+	}
+	for (i = 0; i < n; i++)
+		l->nodes[perm[i]].next = &l->nodes[perm[(i + 1) % n]];
+	free(perm);
+
+	l->p = &l->nodes[0];
+}
+
+static uint64_t
+load_chase_run(struct cpu_load *l)
+{
+	struct chase_node *p;
+	int i;
+
+	p = l->p;
+	for (i = 0; i < LOAD_CHASE_CHUNK; i++)
+		p = p->next;
+	l->p = p;
+
+	return LOAD_CHASE_CHUNK;
+}
+
+#ifdef HAVE_AVX
+/*
+ * Independent FMA chains wide enough to keep the vector units busy and
+ * trip AVX frequency licensing. Counts 2 flops per lane per FMA.
+ */
+__attribute__((target("avx2,fma"))) static uint64_t
+load_avx2_run(struct cpu_load *l)
+{
+	__m256d x0, x1, x2, x3, x4, x5, x6, x7, m, k;
+	double out[4];
+	int i;
+
+	m = _mm256_set1_pd(0.999999);
+	k = _mm256_set1_pd(1e-6);
+	x0 = x1 = x2 = x3 = x4 = x5 = x6 = x7 = _mm256_set1_pd(l->sink);
+	for (i = 0; i < LOAD_AVX_CHUNK; i++) {
+		x0 = _mm256_fmadd_pd(x0, m, k);
+		x1 = _mm256_fmadd_pd(x1, m, k);
+		x2 = _mm256_fmadd_pd(x2, m, k);
+		x3 = _mm256_fmadd_pd(x3, m, k);
+		x4 = _mm256_fmadd_pd(x4, m, k);
+		x5 = _mm256_fmadd_pd(x5, m, k);
+		x6 = _mm256_fmadd_pd(x6, m, k);
+		x7 = _mm256_fmadd_pd(x7, m, k);
+	}
+	x0 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(x0, x1),
+	    _mm256_add_pd(x2, x3)), _mm256_add_pd(_mm256_add_pd(x4, x5),
+	    _mm256_add_pd(x6, x7)));
+	_mm256_storeu_pd(out, x0);
+	l->sink = out[0] / 8.0;
+
+	return (uint64_t)LOAD_AVX_CHUNK * 8 * 4 * 2;
+}
+
+__attribute__((target("avx512f"))) static uint64_t
+load_avx512_run(struct cpu_load *l)
+{
+	__m512d x0, x1, x2, x3, x4, x5, x6, x7, m, k;
+	int i;
+
+	m = _mm512_set1_pd(0.999999);
+	k = _mm512_set1_pd(1e-6);
+	x0 = x1 = x2 = x3 = x4 = x5 = x6 = x7 = _mm512_set1_pd(l->sink);
+	for (i = 0; i < LOAD_AVX_CHUNK; i++) {
+		x0 = _mm512_fmadd_pd(x0, m, k);
+		x1 = _mm512_fmadd_pd(x1, m, k);
+		x2 = _mm512_fmadd_pd(x2, m, k);
+		x3 = _mm512_fmadd_pd(x3, m, k);
+		x4 = _mm512_fmadd_pd(x4, m, k);
+		x5 = _mm512_fmadd_pd(x5, m, k);
+		x6 = _mm512_fmadd_pd(x6, m, k);
+		x7 = _mm512_fmadd_pd(x7, m, k);
+	}
+	x0 = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(x0, x1),
+	    _mm512_add_pd(x2, x3)), _mm512_add_pd(_mm512_add_pd(x4, x5),
+	    _mm512_add_pd(x6, x7)));
+	l->sink = _mm512_reduce_add_pd(x0) / 64.0;
+
+	return (uint64_t)LOAD_AVX_CHUNK * 8 * 8 * 2;
+}
+#endif
+
+/*
+ * Everyone hammers one process shared mutex. Created by main() before
+ * any timer is forked.
+ */
+static void
+load_lock_create(void)
+{
+	pthread_mutexattr_t attr;
+
+	load_lock = mmap(NULL, sizeof(*load_lock), PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (load_lock == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&load_lock->mtx, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static uint64_t
+load_lock_run(struct cpu_load *l)
+{
+	int i;
+
+	for (i = 0; i < LOAD_LOCK_CHUNK; i++) {
+		pthread_mutex_lock(&load_lock->mtx);
+		load_lock->counter++;
+		pthread_mutex_unlock(&load_lock->mtx);
+	}
+
+	return LOAD_LOCK_CHUNK;
+}
+
+static const struct load_kernel load_kernels[NUM_LOAD] = {
+	[LOAD_STREAM]	= { "stream", "MB/s", 1e6,
+			    load_stream_init, load_stream_run },
+	[LOAD_CHASE]	= { "chase", "Mloads/s", 1e6,
+			    load_chase_init, load_chase_run },
+#ifdef HAVE_AVX
+	[LOAD_AVX2]	= { "avx2", "GFLOP/s", 1e9, NULL, load_avx2_run },
+	[LOAD_AVX512]	= { "avx512", "GFLOP/s", 1e9, NULL, load_avx512_run },
+#else
+	[LOAD_AVX2]	= { "avx2" },
+	[LOAD_AVX512]	= { "avx512" },
+#endif
+	[LOAD_LOCK]	= { "lock", "Macq/s", 1e6, NULL, load_lock_run },
+};
+
+/* Whether this CPU can run kernel k. */
+static int
+load_supported(int k)
+{
+
+	if (load_kernels[k].run == NULL)
+		return 0;
+#ifdef HAVE_AVX
+	if (k == LOAD_AVX2)
+		return __builtin_cpu_supports("avx2") &&
+		    __builtin_cpu_supports("fma");
+	if (k == LOAD_AVX512)
+		return __builtin_cpu_supports("avx512f");
+#endif
+	return 1;
+}
+
+/*
+ * Per timer perf counters for --perf. All of them go in one group so a
+ * single read() at each report returns them together; the hardware
+ * ones lead when the PMU and perf_event_paranoid allow, otherwise the
+ * group is software only. Counters that can't be opened report -1.
+ */
+enum {
+	PERF_CS,
+	PERF_MIGR,
+	PERF_FAULTS,
+	PERF_CYCLES,
+	PERF_INSTR,
+	PERF_LLC_MISS,
+	NUM_PERF,
+};
+
+static const struct perf_counter {
+	const char	*name;		/* T> label. */
+	const char	*col;		/* CSV column. */
+	uint32_t	type;
+	uint64_t	config;
+} perf_counters[NUM_PERF] = {
+	[PERF_CS]	= { "CS", "CS", PERF_TYPE_SOFTWARE,
+			    PERF_COUNT_SW_CONTEXT_SWITCHES },
+	[PERF_MIGR]	= { "Migr", "Migr", PERF_TYPE_SOFTWARE,
+			    PERF_COUNT_SW_CPU_MIGRATIONS },
+	[PERF_FAULTS]	= { "Faults", "Faults", PERF_TYPE_SOFTWARE,
+			    PERF_COUNT_SW_PAGE_FAULTS },
+	[PERF_CYCLES]	= { "Cycles", "Cycles", PERF_TYPE_HARDWARE,
+			    PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_INSTR]	= { "Instr", "Instr", PERF_TYPE_HARDWARE,
+			    PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_LLC_MISS]	= { "LLC miss", "LLC_Miss", PERF_TYPE_HARDWARE,
+			    PERF_COUNT_HW_CACHE_MISSES },
+};
+
+struct perf_group {
+	int		fd;		/* Group leader, or -1. */
+	int		fds[NUM_PERF];
+	int		nr;
+	int		which[NUM_PERF];	/* Group position -> PERF_*. */
+	uint64_t	prev[NUM_PERF];
+	uint64_t	prev_enabled, prev_running;
+};
+
+static int use_perf;
+
+/*
+ * Open one counter on the calling thread. Kernel events are excluded
+ * only if perf_event_paranoid demands it.
+ */
+static int
+perf_open_one(int counter, int group_fd)
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = perf_counters[counter].type;
+	attr.config = perf_counters[counter].config;
+	attr.read_format = PERF_FORMAT_GROUP |
+	    PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_hv = 1;
+
+	fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd,
+	    PERF_FLAG_FD_CLOEXEC);
+	if (fd == -1 && (errno == EACCES || errno == EPERM)) {
+		attr.exclude_kernel = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd,
+		    PERF_FLAG_FD_CLOEXEC);
+	}
+
+	return fd;
+}
+
+/*
+ * Counts since the last call, scaled up if the group was multiplexed
+ * off the PMU for part of the interval.
+ */
+static void
+perf_read(struct perf_group *pg, int64_t *out)
+{
+	uint64_t buf[3 + NUM_PERF], enabled, running, v;
+	double scale;
+	int i;
+
+	for (i = 0; i < NUM_PERF; i++)
+		out[i] = -1;
+
+	if (pg->fd == -1 ||
+	    read(pg->fd, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+		return;
+
+	enabled = buf[1] - pg->prev_enabled;
+	running = buf[2] - pg->prev_running;
+	pg->prev_enabled = buf[1];
+	pg->prev_running = buf[2];
+	scale = running > 0 && running < enabled ?
+	    (double)enabled / (double)running : 1.0;
+
+	for (i = 0; i < (int)buf[0] && i < pg->nr; i++) {
+		v = buf[3 + i] - pg->prev[i];
+		pg->prev[i] = buf[3 + i];
+		out[pg->which[i]] = (int64_t)((double)v * scale);
+	}
+}
+
+static void
+perf_open(struct perf_group *pg)
+{
+	int64_t discard[NUM_PERF];
+	int c, fd, first;
+
+	pg->nr = 0;
+	for (c = 0; c < NUM_PERF; c++)
+		pg->fds[c] = -1;
+
+	/* Try a hardware leader first, then fall back to software. */
+	first = PERF_CYCLES;
+	pg->fd = perf_open_one(first, -1);
+	if (pg->fd == -1) {
+		first = PERF_CS;
+		pg->fd = perf_open_one(first, -1);
+	}
+	if (pg->fd == -1) {
+		fprintf(stderr, "perf counters unavailable: %s\n",
+		    strerror(errno));
+		return;
+	}
+	pg->fds[first] = pg->fd;
+	pg->which[pg->nr++] = first;
+
+	for (c = 0; c < NUM_PERF; c++) {
+		if (c == first)
+			continue;
+		fd = perf_open_one(c, pg->fd);
+		if (fd == -1)
+			continue;
+		pg->fds[c] = fd;
+		pg->which[pg->nr++] = c;
+	}
+
+	perf_read(pg, discard);
+}
+
+static void
+perf_close(struct perf_group *pg)
+{
+	int c;
+
+	for (c = 0; c < NUM_PERF; c++)
+		if (pg->fds[c] != -1)
+			close(pg->fds[c]);
+	pg->fd = -1;
+}
+
+#define SPIKE_LOG_SIZE	32	/* Spikes kept per report interval. */
+
+static uint64_t spike_threshold;	/* ns, 0 if off. */
+
+/* One tick over --spike-threshold, as printed on an S> line. */
+struct spike {
+	uint64_t	t;		/* Clock time of the tick. */
+	uint64_t	seq;		/* Tick number; 0 marks an overflow. */
+	uint64_t	gap, late;	/* ns; gap is the count on overflow. */
+	int32_t		pid;
+	int32_t		index;
+	int32_t		cpu;
+	long		nvcsw, nivcsw;	/* Since the interval began. */
+	double		steal_pct, irq_pct, softirq_pct;
+	uint64_t	irqs, softirqs;
+};
+
+/*
+ * Single-producer/single-consumer ring of ticks. The timer signal
+ * handler is the only producer and the work loop the only consumer, so
+ * all the handler does is read the clock and the overrun count and
+ * publish one slot. Statistics, /proc sampling and output all happen
+ * when the work loop drains the ring.
+ */
+#define TICK_RING_SIZE	4096	/* Must be a power of two. */
+
+struct tick {
+	uint64_t	stamp;
+	uint32_t	overrun;	/* Expiries missed before this one. */
+	uint32_t	timer;		/* Sub-timer, see struct subtimer. */
+};
+
+struct tick_ring {
+	uint64_t	head;		/* Written by producer only. */
+	uint64_t	tail;		/* Written by consumer only. */
+	uint64_t	dropped;	/* Ticks lost to a full ring. */
+	struct tick	ticks[TICK_RING_SIZE];
+};
+
+/*
+ * --timers-per-proc: a signal backend timer proc (or thread) arms that
+ * many POSIX timers instead of one. Each timer's sigev_value points at
+ * its entry in one contiguous array, and its ticks share the proc's
+ * ring, tagged with the entry's index. Timers are dealt out to the
+ * --timer-freqs classes in turn, or at random, and spread evenly over
+ * their class's period so they don't all expire at once.
+ */
+#define MAX_TIMER_CLASSES	16
+
+struct subtimer {
+	struct timer_state *st;
+	timer_t		timer;
+	uint64_t	start;		/* Ideal schedule, as in timer_state. */
+	uint64_t	period;
+	uint64_t	seq;
+	uint64_t	last_time;
+	uint32_t	cls;
+};
+
+struct timer_class {
+	uint64_t	period;		/* ns */
+	int		ntimers;
+	uint64_t	overruns, run_overruns;
+	struct hist	win, win_late;
+	struct hist	run, run_late;
+};
+
+static int timers_per_proc = 1;
+static int timer_class_us[MAX_TIMER_CLASSES], ntimer_classes;
+static int timer_class_random;
+
+/*
+ * Everything one timer needs: its ring, its ideal schedule and the
+ * running statistics. One per timer process, or one per thread with
+ * --threads.
+ */
+struct timer_state {
+	int		index;		/* Proc or thread index. */
+	pid_t		tid;
+	int		cpu;		/* Pinned CPU, or -1. */
+	int		backend;	/* TICK_* delivery method. */
+	int		last_cpu;	/* CPU seen at the last report. */
+	timer_t		timer;
+
+	/*
+	 * The ideal schedule: tick n should fire at sched_start + n *
+	 * sched_period. tick_seq is the index of the last tick accounted
+	 * for, including ones the timer overran.
+	 */
+	uint64_t	sched_start;
+	uint64_t	sched_base;	/* sched_start on the timer clock. */
+	uint64_t	sched_period;
+	uint64_t	tick_seq;
+
+	/* Per report interval. */
+	uint64_t	last_time, min, max;
+	uint64_t	gaps;
+	double		gaps_sq;
+	uint64_t	count;
+	uint64_t	overruns;
+	uint64_t	last_dropped;
+	int		use_proc_stat;
+	struct proc_sampler sampler;
+	struct proc_sample sample_start;
+	struct hist	win_hist, win_late_hist;
+
+	/*
+	 * Whole-run histograms, dumped at exit with --hist-dump: gaps
+	 * between ticks and lateness against the ideal schedule.
+	 */
+	struct hist	run_hist, run_late_hist;
+	uint64_t	run_overruns;
+
+	struct tick_ring ring;
+
+	struct arena_slot *slot;	/* NULL unless --aggregate. */
+	struct trace	*trace;		/* NULL unless --record. */
+	struct perf_group perf;		/* fd is -1 unless --perf. */
+	struct cpu_load	*load;		/* NULL unless --cpu-load. */
+
+	/* Spike log of this interval, see spike_capture(). */
+	struct spike	*spikes;	/* SPIKE_LOG_SIZE + 1 entries. */
+	int		nspikes;
+	uint64_t	spikes_lost;
+	int		spike_sampled;
+	struct proc_sample spike_sample;
+	struct rusage	ru_start;
+	int		offline;	/* Replaying a trace (--analyze). */
+
+	/* --timers-per-proc, NULL for a single timer. */
+	struct subtimer	*subs;
+	int		nsubs;
+	struct timer_class *classes;
+	int		status_fd;	/* /proc/self/status, for SigQ. */
+};
+
+static struct timer_state *
+timer_state_alloc(int index)
+{
+	struct timer_state *st;
+	int i;
+
+	if (posix_memalign((void **)&st, 64, sizeof(*st)) != 0) {
+		fprintf(stderr, "Failed to allocate timer state\n");
+		exit(1);
+	}
+
+	memset(st, 0, sizeof(*st));
+	st->index = index;
+	st->cpu = -1;
+	st->last_cpu = -1;
+	st->perf.fd = -1;
+	st->status_fd = -1;
+	for (i = 0; i < NUM_PROC_FILES; i++)
+		st->sampler.fds[i] = -1;
+	st->sched_period = (uint64_t)timerfreq * 1000;
+	hist_reset(&st->run_hist);
+	hist_reset(&st->run_late_hist);
+
+	if (spike_threshold != 0) {
+		st->spikes = calloc(SPIKE_LOG_SIZE + 1, sizeof(*st->spikes));
+		if (st->spikes == NULL) {
+			fprintf(stderr, "Failed to allocate spike log\n");
+			exit(1);
+		}
+	}
+
+	return st;
+}
+
+/*
+ * Whole periods missed before now, for delivery methods that can't
+ * report overruns themselves.
+ */
+static inline uint32_t
+sched_missed(struct timer_state *st, uint64_t now)
+{
+	uint64_t next;
+
+	next = st->sched_start + (st->tick_seq + 1) * st->sched_period;
+	if (now < next + st->sched_period)
+		return 0;
+
+	return (now - next) / st->sched_period;
+}
+
+static inline void
+tick_ring_push(struct tick_ring *r, uint64_t stamp, uint32_t overrun,
+    uint32_t timer)
+{
+	struct tick *t;
+	uint64_t head;
+
+	head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >=
+	    TICK_RING_SIZE) {
+		__atomic_store_n(&r->dropped, r->dropped + 1,
+		    __ATOMIC_RELAXED);
+		return;
+	}
+
+	t = &r->ticks[head & (TICK_RING_SIZE - 1)];
+	t->stamp = stamp;
+	t->overrun = overrun;
+	t->timer = timer;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline int
+tick_ring_pop(struct tick_ring *r, struct tick *t)
+{
+	uint64_t tail;
+
+	tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	if (tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+		return 0;
+
+	*t = r->ticks[tail & (TICK_RING_SIZE - 1)];
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/*
+ * Raw tick trace for --record. Each timer writes every tick it accounts
+ * for into <file>.<index>: a one page header followed by fixed size
+ * records. The file is preallocated and mapped shared up front so that
+ * recording a tick is two stores to memory; the header's record count
+ * is kept current, so a trace survives the process being killed.
+ * --analyze replays a trace through the same statistics code.
+ */
+#define TRACE_MAGIC	"TSTRACE"
+#define TRACE_VERSION	1
+#define TRACE_HDR_SIZE	4096
+#define DFLT_RECORD_TICKS	(1 << 20)
+
+struct trace_hdr {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	hdr_size;
+	uint32_t	rec_size;
+	int32_t		index;
+	int32_t		pid;
+	int32_t		cpu;		/* Pinned CPU, or -1. */
+	char		clock[16];	/* clock_srcs[] name. */
+	char		backend[16];	/* tick_backends[] name. */
+	uint64_t	period;		/* ns */
+	uint64_t	iters;		/* Report interval when recorded. */
+	uint64_t	prog_start;
+	uint64_t	sched_start;	/* Tick n is due at start + n * period. */
+	uint64_t	clock_overhead;
+	uint64_t	capacity;	/* Records the file has room for. */
+	uint64_t	nrecs;		/* Records written so far. */
+	uint64_t	truncated;	/* Ticks seen after the file filled. */
+	char		sched[16];	/* sched_policies[] name. */
+	int32_t		sched_prio;
+	int32_t		mlockall;
+	int32_t		prefault;
+	int32_t		dma_latency;	/* us, -1 if untouched. */
+};
+
+struct trace_rec {
+	uint64_t	stamp;		/* ns, on the recording clock. */
+	uint32_t	overrun;	/* Expiries missed before this one. */
+	uint32_t	lost;		/* Ring drops so far, mod 2^32. */
+};
+
+struct trace {
+	int		fd;
+	size_t		size;
+	struct trace_hdr *hdr;
+	struct trace_rec *recs;
+};
+
+static const char *record_path;
+static uint64_t record_ticks;
+
+static struct trace *
+trace_open(struct timer_state *st)
+{
+	struct trace *tr;
+	char path[PATH_MAX];
+	int ret;
+
+	tr = calloc(1, sizeof(*tr));
+	if (tr == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+
+	snprintf(path, sizeof(path), "%s.%d", record_path, st->index);
+	tr->fd = open(path, O_CREAT|O_RDWR|O_TRUNC, S_IRUSR|S_IWUSR);
+	if (tr->fd == -1) {
+		fprintf(stderr, "Failed to open: %s\n", path);
+		exit(1);
+	}
+
+	/*
+	 * Allocate the blocks now so the hot path never faults on a hole
+	 * (or gets SIGBUS on a full disk), then map and populate it.
+	 */
+	tr->size = TRACE_HDR_SIZE + record_ticks * sizeof(struct trace_rec);
+	ret = posix_fallocate(tr->fd, 0, tr->size);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to allocate %zu bytes for %s: %s\n",
+		    tr->size, path, strerror(ret));
+		exit(1);
+	}
+
+	tr->hdr = mmap(NULL, tr->size, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, tr->fd, 0);
+	if (tr->hdr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	tr->recs = (struct trace_rec *)((char *)tr->hdr + TRACE_HDR_SIZE);
+
+	memcpy(tr->hdr->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	tr->hdr->version = TRACE_VERSION;
+	tr->hdr->hdr_size = TRACE_HDR_SIZE;
+	tr->hdr->rec_size = sizeof(struct trace_rec);
+	tr->hdr->index = st->index;
+	tr->hdr->pid = st->tid;
+	tr->hdr->cpu = st->cpu;
+	snprintf(tr->hdr->clock, sizeof(tr->hdr->clock), "%s",
+	    clock_srcs[clock_src].name);
+	snprintf(tr->hdr->backend, sizeof(tr->hdr->backend), "%s",
+	    tick_backends[st->backend].name);
+	tr->hdr->period = st->sched_period;
+	tr->hdr->iters = iters;
+	tr->hdr->prog_start = prog_start;
+	tr->hdr->clock_overhead = clock_overhead;
+	tr->hdr->capacity = record_ticks;
+	snprintf(tr->hdr->sched, sizeof(tr->hdr->sched), "%s",
+	    sched_policies[sched_pol].name);
+	tr->hdr->sched_prio = sched_prio;
+	tr->hdr->mlockall = use_mlockall;
+	tr->hdr->prefault = use_prefault;
+	tr->hdr->dma_latency = dma_latency;
+
+	return tr;
+}
+
+static inline void
+trace_record(struct trace *tr, uint64_t stamp, uint32_t overrun,
+    uint32_t lost)
+{
+	struct trace_rec *rec;
+	uint64_t n;
+
+	n = tr->hdr->nrecs;
+	if (n == tr->hdr->capacity) {
+		tr->hdr->truncated++;
+		return;
+	}
+
+	rec = &tr->recs[n];
+	rec->stamp = stamp;
+	rec->overrun = overrun;
+	rec->lost = lost;
+	__atomic_store_n(&tr->hdr->nrecs, n + 1, __ATOMIC_RELEASE);
+}
+
+/* Trim the file to the records actually written. */
+static void
+trace_close(struct trace *tr)
+{
+	size_t used;
+
+	if (tr->hdr->truncated != 0)
+		fprintf(stderr, "Trace #%d full, %" PRIu64 " ticks not "
+		    "recorded\n", tr->hdr->index, tr->hdr->truncated);
+
+	used = TRACE_HDR_SIZE + tr->hdr->nrecs * sizeof(struct trace_rec);
+	munmap(tr->hdr, tr->size);
+	if (ftruncate(tr->fd, used) != 0)
+		perror("ftruncate");
+	close(tr->fd);
+	free(tr);
+}
+
+/* One report interval of one timer, as printed on a T> line. */
+struct timer_report {
+	uint64_t	t;		/* Clock time of the last tick. */
+	int32_t		pid;
+	int32_t		index;
+	int32_t		cpu;
+	int32_t		backend;
+	uint64_t	count;
+	uint64_t	min, max;
+	double		avg;		/* us */
+	double		dev;		/* us */
+	double		steal_pct;	/* Of the timer's CPU, or all. */
+	double		irq_pct;
+	double		softirq_pct;
+	uint64_t	irqs, softirqs;	/* Delivered to that CPU. */
+	uint64_t	rq_wait;	/* ns runnable but not running. */
+	uint64_t	pv[NUM_REPORT_PCTS];	/* Gap percentiles. */
+	uint64_t	lv[NUM_REPORT_PCTS];	/* Lateness percentiles. */
+	uint64_t	late_max;
+	uint64_t	lost;
+	uint64_t	dropped;
+	int64_t		perf[NUM_PERF];	/* Counts, -1 if unavailable. */
+	double		load_rate;	/* --cpu-load throughput. */
+};
+
+/* One pass of an I/O proc, as printed on an I> line. */
+struct io_report {
+	uint64_t	t;		/* Clock time the pass ended. */
+	int32_t		pid;
+	int32_t		index;
+	double		bytes;
+	double		us;
+	uint64_t	ops;
+	uint64_t	lat_p50, lat_p99, lat_max;	/* Per op, ns. */
+	uint64_t	sync;		/* fdatasync, ns. */
+};
+
+/* One report window of a memory proc, as printed on an M> line. */
+struct mem_report {
+	uint64_t	t;		/* Clock time the window ended. */
+	int32_t		pid;
+	int32_t		index;
+	double		bytes;		/* Mapped, touched and unmapped. */
+	double		us;
+	uint64_t	minflt, majflt;
+	uint64_t	lat_p50, lat_p99, lat_max;	/* Per chunk, ns. */
+	uint64_t	unmap_max;	/* Slowest munmap, ns. */
+};
+
+/* One report window of a network proc, as printed on an N> line. */
+struct net_report {
+	uint64_t	t;		/* Clock time the window ended. */
+	int32_t		pid;
+	int32_t		index;
+	int32_t		tcp;
+	uint64_t	msgs;		/* Received. */
+	double		bytes;
+	double		us;
+	uint64_t	sent, errors;	/* By this proc's sender. */
+	uint64_t	lat_p50, lat_p99, lat_max;	/* Per message, ns. */
+};
+
+/* One --timer-freqs class of a proc, as printed on a K> line. */
+struct class_report {
+	uint64_t	t;
+	int32_t		pid;
+	int32_t		index;
+	int32_t		cls;
+	int32_t		ntimers;
+	int32_t		total;		/* Whole run rather than interval. */
+	uint64_t	period;
+	uint64_t	count;
+	uint64_t	dropped;
+	uint64_t	pv[NUM_REPORT_PCTS];
+	uint64_t	lv[NUM_REPORT_PCTS];
+	uint64_t	max, late_max;
+	int64_t		sigq, sigq_max;	/* /proc SigQ, -1 if unknown. */
+};
+
+static void
+timer_report_print(const struct timer_report *r)
+{
+	char pl[256], pc[128], ll[64], lc[64];
+	int c, nl, nc;
+
+	/* With --perf the counters go next to the gap statistics. */
+	pl[0] = pc[0] = '\0';
+	for (c = 0, nl = nc = 0; use_perf && c < NUM_PERF; c++) {
+		nl += snprintf(pl + nl, sizeof(pl) - nl, "%s: %" PRId64 ", ",
+		    perf_counters[c].name, r->perf[c]);
+		nc += snprintf(pc + nc, sizeof(pc) - nc, "%" PRId64 ",",
+		    r->perf[c]);
+	}
+
+	/* And the --cpu-load kernel's throughput goes last. */
+	ll[0] = lc[0] = '\0';
+	if (cpu_load != -1) {
+		snprintf(ll, sizeof(ll), ", Load: %s %.1f %s",
+		    load_kernels[cpu_load].name, r->load_rate,
+		    load_kernels[cpu_load].unit);
+		snprintf(lc, sizeof(lc), ",%s,%.1f",
+		    load_kernels[cpu_load].name, r->load_rate);
+	}
+
+	printf("T> P: %d, I: %ld, Min: %.3f, Max: %.3f, Avg: %9.3f, Dev: %5.1f%% (%4.2f), %sSteal pct: %5.1f%%, "
+	    "IRQ pct: %4.1f%%, SoftIRQ pct: %4.1f%%, IRQs: %ld, SoftIRQs: %ld, RQ wait: %.3f, "
+	    "p50: %.3f, p90: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Lost: %ld, "
+	    "Late p50: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, Dropped: %ld, CPU: %d, Backend: %s%s\n",
+	    r->pid, r->count, NS_TO_US(r->min), NS_TO_US(r->max), r->avg,
+	    (r->dev / (double)timerfreq) * 100.0, r->dev, pl, r->steal_pct,
+	    r->irq_pct, r->softirq_pct, r->irqs, r->softirqs,
+	    NS_TO_US(r->rq_wait),
+	    NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]), NS_TO_US(r->pv[2]),
+	    NS_TO_US(r->pv[3]), NS_TO_US(r->pv[4]), r->lost,
+	    NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]), NS_TO_US(r->lv[3]),
+	    NS_TO_US(r->lv[4]), NS_TO_US(r->late_max), r->dropped, r->cpu,
+	    tick_backends[r->backend].name, ll);
+	fflush(stdout);
+
+	if (tcsv_fd != -1)
+		write_fd(tcsv_fd,
+		    "%ld,%ld,%.3f,%.3f,%.3f,%.1f,%.2f,%s%.1f,"
+		    "%.1f,%.1f,%ld,%ld,%.3f,"
+		    "%.3f,%.3f,%.3f,%.3f,%.3f,%ld,"
+		    "%.3f,%.3f,%.3f,%.3f,%.3f,%ld,%d,%d,%s,%s,%d,%d,%d,%d%s\n",
+		    (r->t - prog_start) / 1000000000,
+		    r->count, NS_TO_US(r->min), NS_TO_US(r->max), r->avg,
+		    (r->dev / (double)timerfreq) * 100.0, r->dev, pc,
+		    r->steal_pct, r->irq_pct, r->softirq_pct, r->irqs,
+		    r->softirqs, NS_TO_US(r->rq_wait),
+		    NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]),
+		    NS_TO_US(r->pv[2]), NS_TO_US(r->pv[3]),
+		    NS_TO_US(r->pv[4]), r->lost,
+		    NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]),
+		    NS_TO_US(r->lv[3]), NS_TO_US(r->lv[4]),
+		    NS_TO_US(r->late_max), r->dropped, r->index, r->cpu,
+		    tick_backends[r->backend].name,
+		    sched_policies[sched_pol].name, sched_prio, use_mlockall,
+		    use_prefault, dma_latency, lc);
+}
+
+static void
+io_report_print(const struct io_report *r)
+{
+
+	printf("I> P: %d, MBytes: %5.1f, Time (s): %4.1f, MB/s: %5.1f, "
+	    "IOPS: %.0f, Lat p50: %.3f, p99: %.3f, Max: %.3f, Sync: %.3f\n",
+	    r->pid,
+	    r->bytes / 1000000.0,
+	    r->us / 1000000.0,
+	    r->bytes / r->us,
+	    r->ops / (r->us / 1000000.0),
+	    NS_TO_US(r->lat_p50), NS_TO_US(r->lat_p99),
+	    NS_TO_US(r->lat_max), NS_TO_US(r->sync));
+	fflush(stdout);
+
+	if (icsv_fd != -1)
+		write_fd(icsv_fd, "%ld,%.1f,%.1f,%.1f,%.0f,%.3f,%.3f,%.3f,%.3f\n",
+		    (r->t - prog_start) / 1000000000,
+		    r->bytes / 1000000.0,
+		    r->us / 1000000.0,
+		    r->bytes / r->us,
+		    r->ops / (r->us / 1000000.0),
+		    NS_TO_US(r->lat_p50), NS_TO_US(r->lat_p99),
+		    NS_TO_US(r->lat_max), NS_TO_US(r->sync));
+}
+
+static void
+class_report_print(const struct class_report *r)
+{
+	char t[32];
+
+	printf("K> P: %d, %sClass: %d, Freq: %.0f us, Timers: %d, "
+	    "Ticks: %" PRIu64 ", "
+	    "p50: %.3f, p90: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Late p50: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Dropped: %" PRIu64 ", SigQ: %" PRId64 "/%" PRId64 "\n",
+	    r->pid, r->total ? "Total, " : "", r->cls, NS_TO_US(r->period),
+	    r->ntimers, r->count, NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]),
+	    NS_TO_US(r->pv[2]), NS_TO_US(r->pv[3]), NS_TO_US(r->pv[4]),
+	    NS_TO_US(r->max), NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]),
+	    NS_TO_US(r->lv[3]), NS_TO_US(r->lv[4]), NS_TO_US(r->late_max),
+	    r->dropped, r->sigq, r->sigq_max);
+	fflush(stdout);
+
+	if (kcsv_fd == -1)
+		return;
+
+	if (r->total)
+		snprintf(t, sizeof(t), "total");
+	else
+		snprintf(t, sizeof(t), "%ld",
+		    (long)((r->t - prog_start) / 1000000000));
+	write_fd(kcsv_fd, "%s,%d,%d,%.0f,%d,%" PRIu64 ","
+	    "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+	    "%.3f,%.3f,%.3f,%.3f,%.3f,%" PRIu64 ",%" PRId64 ",%" PRId64 "\n",
+	    t, r->index, r->cls, NS_TO_US(r->period), r->ntimers, r->count,
+	    NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]), NS_TO_US(r->pv[2]),
+	    NS_TO_US(r->pv[3]), NS_TO_US(r->pv[4]), NS_TO_US(r->max),
+	    NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]), NS_TO_US(r->lv[3]),
+	    NS_TO_US(r->lv[4]), NS_TO_US(r->late_max), r->dropped, r->sigq,
+	    r->sigq_max);
+}
+
+static void
+mem_report_print(const struct mem_report *r)
+{
+	double secs = r->us / 1000000.0;
+
+	printf("M> P: %d, MBytes: %6.1f, Time (s): %4.1f, MB/s: %6.1f, "
+	    "Faults/s: %.0f, Major: %" PRIu64 ", Alloc p50: %.3f, p99: %.3f, "
+	    "Max: %.3f, Unmap max: %.3f\n",
+	    r->pid,
+	    r->bytes / 1000000.0,
+	    secs,
+	    r->bytes / r->us,
+	    (r->minflt + r->majflt) / secs, r->majflt,
+	    NS_TO_US(r->lat_p50), NS_TO_US(r->lat_p99),
+	    NS_TO_US(r->lat_max), NS_TO_US(r->unmap_max));
+	fflush(stdout);
+
+	if (mcsv_fd != -1)
+		write_fd(mcsv_fd, "%ld,%.1f,%.1f,%.1f,%.0f,%" PRIu64 ","
+		    "%.3f,%.3f,%.3f,%.3f\n",
+		    (r->t - prog_start) / 1000000000,
+		    r->bytes / 1000000.0,
+		    secs,
+		    r->bytes / r->us,
+		    (r->minflt + r->majflt) / secs, r->majflt,
+		    NS_TO_US(r->lat_p50), NS_TO_US(r->lat_p99),
+		    NS_TO_US(r->lat_max), NS_TO_US(r->unmap_max));
+}
+
+static void
+net_report_print(const struct net_report *r)
+{
+	double secs = r->us / 1000000.0;
+
+	printf("N> P: %d, Proto: %s, Msgs: %" PRIu64 ", Time (s): %4.1f, "
+	    "PPS: %.0f, Gbps: %.3f, Lat p50: %.3f, p99: %.3f, Max: %.3f, "
+	    "Sent: %" PRIu64 ", Errors: %" PRIu64 "\n",
+	    r->pid, r->tcp ? "tcp" : "udp", r->msgs, secs,
+	    r->msgs / secs, r->bytes * 8 / r->us / 1000.0,
+	    NS_TO_US(r->lat_p50), NS_TO_US(r->lat_p99),
+	    NS_TO_US(r->lat_max), r->sent, r->errors);
+	fflush(stdout);
+
+	if (ncsv_fd != -1)
+		write_fd(ncsv_fd, "%ld,%s,%" PRIu64 ",%.1f,%.0f,%.3f,"
+		    "%.3f,%.3f,%.3f,%" PRIu64 ",%" PRIu64 "\n",
+		    (r->t - prog_start) / 1000000000,
+		    r->tcp ? "tcp" : "udp", r->msgs, secs,
+		    r->msgs / secs, r->bytes * 8 / r->us / 1000.0,
+		    NS_TO_US(r->lat_p50), NS_TO_US(r->lat_p99),
+		    NS_TO_US(r->lat_max), r->sent, r->errors);
+}
+
+/*
+ * Shared result arena for --aggregate. It is mapped shared before any
+ * child is forked and holds one slot per timer (proc or thread), I/O
+ * proc, memory proc and network proc. Each slot is written by its
+ * owner only: reports go through an SPSC ring and the cumulative
+ * histograms are refreshed in place at every report, so hundreds of
+ * children never contend on a cache line. A single collector drains
+ * the rings, diffs the histograms against its previous snapshot and
+ * prints one consolidated line per interval.
+ */
+#define REPORT_RING_SIZE	64	/* Must be a power of two. */
+
+/* Spike and class are report kinds only. */
+enum { SLOT_TIMER, SLOT_IO, SLOT_MEM, SLOT_SPIKE, SLOT_CLASS, SLOT_NET };
+
+struct report {
+	int32_t		kind;		/* SLOT_* */
+	union {
+		struct timer_report	timer;
+		struct io_report	io;
+		struct mem_report	mem;
+		struct spike		spike;
+		struct class_report	klass;
+		struct net_report	net;
+	};
+};
+
+struct report_ring {
+	uint64_t	head __attribute__((aligned(64)));
+	uint64_t	tail __attribute__((aligned(64)));
+	uint64_t	dropped;
+	struct report	reports[REPORT_RING_SIZE];
+};
+
+struct arena_slot {
+	int32_t		kind;		/* SLOT_* */
+	int32_t		index;
+	pid_t		pid;
+	struct report_ring ring;
+	struct hist	run_hist;
+	struct hist	run_late_hist;
+} __attribute__((aligned(64)));
+
+struct arena {
+	int		nslots;
+	struct arena_slot slots[];
+};
+
+static struct arena *arena;
+
+static struct arena *
+arena_create(int nslots)
+{
+	struct arena *a;
+	size_t size;
+	int i;
+
+	size = sizeof(*a) + nslots * sizeof(a->slots[0]);
+	a = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+	    -1, 0);
+	if (a == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %zu byte arena: %s\n", size,
+		    strerror(errno));
+		exit(1);
+	}
+
+	a->nslots = nslots;
+	for (i = 0; i < nslots; i++) {
+		hist_reset(&a->slots[i].run_hist);
+		hist_reset(&a->slots[i].run_late_hist);
+	}
+
+	return a;
+}
+
+static inline void
+report_ring_push(struct report_ring *r, const struct report *rep)
+{
+	uint64_t head;
+
+	head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >=
+	    REPORT_RING_SIZE) {
+		__atomic_store_n(&r->dropped, r->dropped + 1,
+		    __ATOMIC_RELAXED);
+		return;
+	}
+
+	r->reports[head & (REPORT_RING_SIZE - 1)] = *rep;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline int
+report_ring_pop(struct report_ring *r, struct report *rep)
+{
+	uint64_t tail;
+
+	tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	if (tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+		return 0;
+
+	*rep = r->reports[tail & (REPORT_RING_SIZE - 1)];
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/*
+ * Copy the whole-run histograms into the arena. The collector tolerates
+ * a torn copy; it only diffs counters.
+ */
+static void
+timer_slot_sync(struct timer_state *st)
+{
+
+	memcpy(&st->slot->run_hist, &st->run_hist, sizeof(st->run_hist));
+	memcpy(&st->slot->run_late_hist, &st->run_late_hist,
+	    sizeof(st->run_late_hist));
+}
+
+/* Print the report, or hand it to the collector with --aggregate. */
+static void
+timer_report_publish(struct timer_state *st, const struct timer_report *r)
+{
+	struct report rep;
+
+	if (st->slot == NULL) {
+		timer_report_print(r);
+		return;
+	}
+
+	timer_slot_sync(st);
+
+	rep.kind = SLOT_TIMER;
+	rep.timer = *r;
+	report_ring_push(&st->slot->ring, &rep);
+}
+
+static void
+io_report_publish(struct arena_slot *slot, const struct io_report *r)
+{
+	struct report rep;
+
+	if (slot == NULL) {
+		io_report_print(r);
+		return;
+	}
+
+	rep.kind = SLOT_IO;
+	rep.io = *r;
+	report_ring_push(&slot->ring, &rep);
+}
+
+static void
+mem_report_publish(struct arena_slot *slot, const struct mem_report *r)
+{
+	struct report rep;
+
+	if (slot == NULL) {
+		mem_report_print(r);
+		return;
+	}
+
+	rep.kind = SLOT_MEM;
+	rep.mem = *r;
+	report_ring_push(&slot->ring, &rep);
+}
+
+static void
+net_report_publish(struct arena_slot *slot, const struct net_report *r)
+{
+	struct report rep;
+
+	if (slot == NULL) {
+		net_report_print(r);
+		return;
+	}
+
+	rep.kind = SLOT_NET;
+	rep.net = *r;
+	report_ring_push(&slot->ring, &rep);
+}
+
+/*
+ * Spike capture for --spike-threshold. A gap over the threshold is
+ * marked in the ftrace buffer straight away, so kernel traces can be
+ * lined up with it, and a snapshot of its context goes into the timer's
+ * fixed size spike log. That happens in the work loop after the tick
+ * is accounted, never in handle_sig(), and costs one write() plus one
+ * getrusage(); /proc is re-sampled at most once per interval. The log
+ * is emitted as S> lines at the next report.
+ */
+static int trace_marker_fd = -1, scsv_fd = -1;
+
+static void
+trace_marker_open(void)
+{
+	static const char *paths[] = {
+		"/sys/kernel/tracing/trace_marker",
+		"/sys/kernel/debug/tracing/trace_marker",
+	};
+	unsigned i;
+
+	for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+		trace_marker_fd = open(paths[i], O_WRONLY|O_CLOEXEC);
+		if (trace_marker_fd != -1)
+			return;
+	}
+}
+
+static void
+spike_print(const struct spike *sp)
+{
+
+	if (sp->seq == 0) {
+		printf("S> P: %d, %" PRIu64 " more spikes not logged\n",
+		    sp->pid, sp->gap);
+		fflush(stdout);
+		return;
+	}
+
+	printf("S> P: %d, t: %.6f, Seq: %" PRIu64 ", Gap: %.3f, Late: %.3f, "
+	    "CPU: %d, Vol CS: %ld, Invol CS: %ld, Steal pct: %5.1f%%, "
+	    "IRQ pct: %4.1f%%, SoftIRQ pct: %4.1f%%, IRQs: %" PRIu64 ", "
+	    "SoftIRQs: %" PRIu64 "\n",
+	    sp->pid, (double)(sp->t - prog_start) / 1000000000.0, sp->seq,
+	    NS_TO_US(sp->gap), NS_TO_US(sp->late), sp->cpu, sp->nvcsw,
+	    sp->nivcsw, sp->steal_pct, sp->irq_pct, sp->softirq_pct,
+	    sp->irqs, sp->softirqs);
+	fflush(stdout);
+
+	if (scsv_fd != -1)
+		write_fd(scsv_fd, "%.6f,%d,%" PRIu64 ",%.3f,%.3f,%d,%ld,%ld,"
+		    "%.1f,%.1f,%.1f,%" PRIu64 ",%" PRIu64 "\n",
+		    (double)(sp->t - prog_start) / 1000000000.0, sp->index,
+		    sp->seq, NS_TO_US(sp->gap), NS_TO_US(sp->late), sp->cpu,
+		    sp->nvcsw, sp->nivcsw, sp->steal_pct, sp->irq_pct,
+		    sp->softirq_pct, sp->irqs, sp->softirqs);
+}
+
+static void
+spike_capture(struct timer_state *st, uint64_t stamp, uint64_t gap,
+    uint64_t late)
+{
+	struct proc_sample now, *start = &st->sample_start;
+	struct spike *sp;
+	struct rusage ru;
+	uint64_t hz;
+	char buf[128];
+	int n;
+
+	if (trace_marker_fd != -1) {
+		n = snprintf(buf, sizeof(buf), "timer_stability: spike timer "
+		    "%d seq %" PRIu64 " gap %" PRIu64 " ns late %" PRIu64
+		    " ns\n", st->index, st->tick_seq, gap, late);
+		write(trace_marker_fd, buf, n);
+	}
+
+	if (st->nspikes == SPIKE_LOG_SIZE) {
+		st->spikes_lost++;
+		return;
+	}
+
+	sp = &st->spikes[st->nspikes++];
+	sp->t = stamp;
+	sp->seq = st->tick_seq;
+	sp->gap = gap;
+	sp->late = late;
+	sp->pid = st->tid;
+	sp->index = st->index;
+	sp->cpu = st->offline ? st->cpu : sched_getcpu();
+
+	sp->nvcsw = sp->nivcsw = -1;
+	if (!st->offline && getrusage(RUSAGE_THREAD, &ru) == 0) {
+		sp->nvcsw = ru.ru_nvcsw - st->ru_start.ru_nvcsw;
+		sp->nivcsw = ru.ru_nivcsw - st->ru_start.ru_nivcsw;
+	}
+
+	/* /proc deltas since the interval began, sampled once. */
+	if (st->use_proc_stat && !st->spike_sampled) {
+		st->spike_sampled = 1;
+		if (proc_sample(&st->sampler, start->cpu, &now) == 0 &&
+		    now.cpu == start->cpu)
+			st->spike_sample = now;
+		else
+			st->spike_sample = *start;
+	} else if (!st->use_proc_stat)
+		st->spike_sample = *start;
+
+	hz = total_proc_stat_time(&st->spike_sample.stat) -
+	    total_proc_stat_time(&start->stat);
+#define HZ_PCT(f)	(hz == 0 ? -0.1 : (double)(st->spike_sample.stat.f - \
+	    start->stat.f) / hz * 100.0)
+	sp->steal_pct = HZ_PCT(steal);
+	sp->irq_pct = HZ_PCT(irq);
+	sp->softirq_pct = HZ_PCT(softirq);
+#undef HZ_PCT
+	sp->irqs = st->spike_sample.irqs - start->irqs;
+	sp->softirqs = st->spike_sample.softirqs - start->softirqs;
+}
+
+/* Emit and empty the spike log, through the arena if there is one. */
+static void
+spike_flush(struct timer_state *st)
+{
+	struct report rep;
+	int i;
+
+	if (st->spikes_lost != 0) {
+		st->spikes[st->nspikes].seq = 0;
+		st->spikes[st->nspikes].pid = st->tid;
+		st->spikes[st->nspikes].gap = st->spikes_lost;
+		st->nspikes++;
+	}
+
+	for (i = 0; i < st->nspikes; i++) {
+		if (st->slot == NULL) {
+			spike_print(&st->spikes[i]);
+			continue;
+		}
+		rep.kind = SLOT_SPIKE;
+		rep.spike = st->spikes[i];
+		report_ring_push(&st->slot->ring, &rep);
+	}
+
+	st->nspikes = 0;
+	st->spikes_lost = 0;
+	st->spike_sampled = 0;
+}
+
+/*
+ * cgroup v2 isolation for --cgroup. main() creates one child group per
+ * proc class under the given directory, enables the controllers the
+ * --cgroup-set files need in its subtree and writes them, and every
+ * proc moves itself into its class' group once forked. The groups are
+ * left in place for inspection and reused by the next run. At every
+ * report interval the reporter, the collector with --aggregate and
+ * timer #0 otherwise, reads back each group's cpu.stat and PSI totals
+ * and prints their deltas on G> lines (and to file.cgroup.csv), with
+ * stall time as a percentage of the interval.
+ */
+#define MAX_CG_SETTINGS	32
+
+enum { CG_TIMER, CG_IO, CG_MEM, CG_NET, NUM_CG };
+
+static const char *const cg_names[NUM_CG] = {
+	[CG_TIMER]	= "timer",
+	[CG_IO]		= "io",
+	[CG_MEM]	= "mem",
+	[CG_NET]	= "net",
+};
+
+/* Files --cgroup-set may write, and the controller each needs. */
+static const struct {
+	const char	*file;
+	const char	*controller;
+} cg_files[] = {
+	{ "cpu.max", "cpu" },
+	{ "cpu.weight", "cpu" },
+	{ "io.max", "io" },
+	{ "io.weight", "io" },
+	{ "cpuset.cpus", "cpuset" },
+	{ "cpuset.mems", "cpuset" },
+};
+#define NUM_CG_FILES	(sizeof(cg_files) / sizeof(cg_files[0]))
+
+struct cg_setting {
+	int		cls;
+	int		file;		/* Index into cg_files[]. */
+	const char	*value;
+};
+
+/* Cumulative counters; the report prints the deltas. */
+enum { PSI_CPU_SOME, PSI_CPU_FULL, PSI_IO_SOME, PSI_IO_FULL,
+    PSI_MEM_SOME, PSI_MEM_FULL, NUM_PSI };
+
+struct cg_stat {
+	uint64_t	t;
+	uint64_t	usage_us;
+	uint64_t	periods, throttled, throttled_us;
+	uint64_t	psi[NUM_PSI];	/* Stall totals, us. */
+};
+
+static const char *cgroup_root;
+static struct cg_setting cg_settings[MAX_CG_SETTINGS];
+static int ncg_settings;
+static int cg_used[NUM_CG];
+static struct cg_stat cg_prev[NUM_CG];
+static int gcsv_fd = -1;
+
+/* Parse "<class>.<file>=<value>" into cg_settings[]. */
+static int
+cgroup_parse_setting(const char *arg)
+{
+	struct cg_setting *cs;
+	const char *dot, *eq;
+	size_t len;
+	int c;
+	unsigned f;
+
+	dot = strchr(arg, '.');
+	eq = strchr(arg, '=');
+	if (dot == NULL || eq == NULL || eq < dot ||
+	    ncg_settings == MAX_CG_SETTINGS)
+		return -1;
+
+	for (c = 0; c < NUM_CG; c++)
+		if (strlen(cg_names[c]) == (size_t)(dot - arg) &&
+		    strncmp(arg, cg_names[c], dot - arg) == 0)
+			break;
+	len = eq - dot - 1;
+	for (f = 0; f < NUM_CG_FILES; f++)
+		if (strlen(cg_files[f].file) == len &&
+		    strncmp(dot + 1, cg_files[f].file, len) == 0)
+			break;
+	if (c == NUM_CG || f == NUM_CG_FILES)
+		return -1;
+
+	cs = &cg_settings[ncg_settings++];
+	cs->cls = c;
+	cs->file = f;
+	cs->value = eq + 1;
+
+	return 0;
+}
+
+static int
+cgroup_write(const char *path, const char *value)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	ret = write(fd, value, strlen(value)) == (ssize_t)strlen(value) ?
+	    0 : -1;
+	close(fd);
+
+	return ret;
+}
+
+static ssize_t
+cgroup_read(int cls, const char *file, char *buf, size_t size)
+{
+	char path[PATH_MAX];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s/%s", cgroup_root, cg_names[cls],
+	    file);
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	buf[n > 0 ? n : 0] = '\0';
+
+	return n;
+}
+
+/* The total= of the "some" and "full" lines of a pressure file. */
+static void
+cgroup_read_psi(int cls, const char *file, uint64_t *some, uint64_t *full)
+{
+	char buf[512], *p;
+
+	*some = *full = 0;
+	if (cgroup_read(cls, file, buf, sizeof(buf)) <= 0)
+		return;
+	if ((p = strstr(buf, "some ")) != NULL &&
+	    (p = strstr(p, "total=")) != NULL)
+		*some = strtoull(p + 6, NULL, 10);
+	if ((p = strstr(buf, "full ")) != NULL &&
+	    (p = strstr(p, "total=")) != NULL)
+		*full = strtoull(p + 6, NULL, 10);
+}
+
+static void
+cgroup_read_stat(int cls, struct cg_stat *cs)
+{
+	char buf[1024], key[32];
+	uint64_t v;
+	char *p;
+
+	memset(cs, 0, sizeof(*cs));
+	cs->t = get_time();
+	if (cgroup_read(cls, "cpu.stat", buf, sizeof(buf)) > 0)
+		for (p = buf; sscanf(p, "%31s %" SCNu64, key, &v) == 2;
+		    p = strchr(p, '\n') + 1) {
+			if (strcmp(key, "usage_usec") == 0)
+				cs->usage_us = v;
+			else if (strcmp(key, "nr_periods") == 0)
+				cs->periods = v;
+			else if (strcmp(key, "nr_throttled") == 0)
+				cs->throttled = v;
+			else if (strcmp(key, "throttled_usec") == 0)
+				cs->throttled_us = v;
+			if (strchr(p, '\n') == NULL)
+				break;
+		}
+
+	cgroup_read_psi(cls, "cpu.pressure", &cs->psi[PSI_CPU_SOME],
+	    &cs->psi[PSI_CPU_FULL]);
+	cgroup_read_psi(cls, "io.pressure", &cs->psi[PSI_IO_SOME],
+	    &cs->psi[PSI_IO_FULL]);
+	cgroup_read_psi(cls, "memory.pressure", &cs->psi[PSI_MEM_SOME],
+	    &cs->psi[PSI_MEM_FULL]);
+}
+
+static void
+cgroup_setup(void)
+{
+	char path[PATH_MAX], ctl[16];
+	const struct cg_setting *cs;
+	unsigned f, g;
+	int c, i;
+
+	if (mkdir(cgroup_root, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Failed to create %s: %s\n", cgroup_root,
+		    strerror(errno));
+		exit(1);
+	}
+
+	/* Each controller once, however many files need it. */
+	snprintf(path, sizeof(path), "%s/cgroup.subtree_control",
+	    cgroup_root);
+	for (f = 0; f < NUM_CG_FILES; f++) {
+		for (i = 0; i < ncg_settings; i++)
+			if (strcmp(cg_files[cg_settings[i].file].controller,
+			    cg_files[f].controller) == 0)
+				break;
+		for (g = 0; g < f; g++)
+			if (strcmp(cg_files[g].controller,
+			    cg_files[f].controller) == 0)
+				break;
+		if (i == ncg_settings || g < f)
+			continue;
+		snprintf(ctl, sizeof(ctl), "+%s", cg_files[f].controller);
+		if (cgroup_write(path, ctl) != 0) {
+			fprintf(stderr, "Failed to enable %s in %s: %s\n",
+			    cg_files[f].controller, path, strerror(errno));
+			exit(1);
+		}
+	}
+
+	for (c = 0; c < NUM_CG; c++) {
+		if (!cg_used[c])
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", cgroup_root, cg_names[c]);
+		if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+			fprintf(stderr, "Failed to create %s: %s\n", path,
+			    strerror(errno));
+			exit(1);
+		}
+
+		printf("Cgroup: %s", path);
+		for (i = 0; i < ncg_settings; i++) {
+			cs = &cg_settings[i];
+			if (cs->cls != c)
+				continue;
+			snprintf(path, sizeof(path), "%s/%s/%s", cgroup_root,
+			    cg_names[c], cg_files[cs->file].file);
+			if (cgroup_write(path, cs->value) != 0) {
+				fprintf(stderr, "\nFailed to write '%s' to %s: "
+				    "%s\n", cs->value, path, strerror(errno));
+				exit(1);
+			}
+			printf(", %s: %s", cg_files[cs->file].file, cs->value);
+		}
+		printf("\n");
+
+		cgroup_read_stat(c, &cg_prev[c]);
+	}
+	fflush(stdout);
+}
+
+/* Move the calling process, all its threads, into the class' group. */
+static void
+cgroup_join(int cls)
+{
+	char path[PATH_MAX], pid[16];
+
+	if (cgroup_root == NULL)
+		return;
+
+	snprintf(path, sizeof(path), "%s/%s/cgroup.procs", cgroup_root,
+	    cg_names[cls]);
+	snprintf(pid, sizeof(pid), "%d", (int)getpid());
+	if (cgroup_write(path, pid) != 0) {
+		fprintf(stderr, "Failed to join %s: %s\n", path,
+		    strerror(errno));
+		exit(1);
+	}
+}
+
+/* Print every group's counters since the last call, or the start. */
+static void
+cgroup_report(uint64_t now)
+{
+	struct cg_stat cur, *prev;
+	double us, pct[NUM_PSI];
+	int c, i;
+
+	for (c = 0; c < NUM_CG; c++) {
+		if (!cg_used[c])
+			continue;
+		prev = &cg_prev[c];
+		cgroup_read_stat(c, &cur);
+		us = NS_TO_US(cur.t - prev->t);
+		for (i = 0; i < NUM_PSI; i++)
+			pct[i] = (cur.psi[i] - prev->psi[i]) * 100.0 / us;
+
+		printf("G> Group: %s, CPU (ms): %.1f, Throttled: %" PRIu64
+		    "/%" PRIu64 " periods, %.1f ms, CPU some: %.1f%%, "
+		    "full: %.1f%%, IO some: %.1f%%, full: %.1f%%, "
+		    "Mem some: %.1f%%, full: %.1f%%\n",
+		    cg_names[c], (cur.usage_us - prev->usage_us) / 1e3,
+		    cur.throttled - prev->throttled, cur.periods - prev->periods,
+		    (cur.throttled_us - prev->throttled_us) / 1e3,
+		    pct[PSI_CPU_SOME], pct[PSI_CPU_FULL], pct[PSI_IO_SOME],
+		    pct[PSI_IO_FULL], pct[PSI_MEM_SOME], pct[PSI_MEM_FULL]);
+
+		if (gcsv_fd != -1)
+			write_fd(gcsv_fd, "%ld,%s,%.1f,%" PRIu64 ",%" PRIu64
+			    ",%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			    (now - prog_start) / 1000000000, cg_names[c],
+			    (cur.usage_us - prev->usage_us) / 1e3,
+			    cur.periods - prev->periods,
+			    cur.throttled - prev->throttled,
+			    (cur.throttled_us - prev->throttled_us) / 1e3,
+			    pct[PSI_CPU_SOME], pct[PSI_CPU_FULL],
+			    pct[PSI_IO_SOME], pct[PSI_IO_FULL],
+			    pct[PSI_MEM_SOME], pct[PSI_MEM_FULL]);
+
+		*prev = cur;
+	}
+	fflush(stdout);
+}
+
+/*
+ * --phase: every timer parks on a barrier in shared memory once it is
+ * set up, and the last one to arrive picks a release time far enough
+ * ahead for all of them to wake. Each timer's schedule then starts at
+ * the release plus its phase offset: none (a thundering herd), spread
+ * evenly over one period by index, or random. The first tick of every
+ * timer is kept so the alignment actually reached can be reported.
+ */
+#define LAUNCH_LEAD	100000000ULL	/* ns from release to start. */
+
+enum { PHASE_ALIGNED, PHASE_STAGGER, PHASE_RANDOM, NUM_PHASE };
+
+static const char *const phase_names[NUM_PHASE] = {
+	[PHASE_ALIGNED]	= "aligned",
+	[PHASE_STAGGER]	= "stagger",
+	[PHASE_RANDOM]	= "random",
+};
+
+struct launch_proc {
+	uint64_t	ready;		/* Parked on the barrier. */
+	uint64_t	first;		/* First tick, 0 until then. */
+	int64_t		first_late;	/* Against its ideal time. */
+};
+
+struct launch {
+	int		nprocs;
+	uint64_t	start;		/* First fork. */
+	uint64_t	release;	/* Schedules start here, plus phase. */
+	uint32_t	arrived;
+	uint32_t	go;		/* Futex, set at release. */
+	uint32_t	firsts;
+	struct launch_proc procs[];
+};
+
+static struct launch *launch;
+static int launch_phase = -1;		/* -1: no barrier. */
+static int launch_fanout;		/* 0: fork all from main(). */
+
+static struct launch *
+launch_create(int nprocs)
+{
+	struct launch *l;
+	size_t size;
+
+	size = sizeof(*l) + nprocs * sizeof(l->procs[0]);
+	l = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+	    -1, 0);
+	if (l == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	l->nprocs = nprocs;
+	l->start = get_time();
+
+	return l;
+}
+
+/*
+ * Fork the timers lo..hi-1 as a tree: the caller forks up to fanout
+ * children, each taking the first index of an equal share and forking
+ * the rest of its share the same way. All of them are reparented to
+ * main(), a subreaper, when their parent exits. Returns the index the
+ * calling process is to run, or -1 in the caller.
+ */
+static int
+launch_tree(int lo, int hi)
+{
+	int i, chunk, self;
+	pid_t pid;
+
+	self = -1;
+	while (lo < hi) {
+		chunk = launch_fanout > 0 ?
+		    (hi - lo + launch_fanout - 1) / launch_fanout : 1;
+		for (i = lo; i < hi; i += chunk) {
+			pid = fork();
+			if (pid == -1) {
+				perror("fork");
+				exit(1);
+			} else if (pid == 0)
+				break;
+
+			if (arena != NULL)
+				arena->slots[i].pid = pid;
+		}
+		if (i >= hi)
+			break;
+
+		self = i;
+		hi = i + chunk < hi ? i + chunk : hi;
+		lo = i + 1;
+	}
+
+	return self;
+}
+
+/*
+ * Park until every timer is ready. The last one to arrive reports the
+ * launch and releases the rest.
+ */
+static void
+launch_wait(struct timer_state *st)
+{
+	struct launch *l = launch;
+	uint64_t now;
+
+	now = get_time();
+	l->procs[st->index].ready = now;
+	if (__atomic_add_fetch(&l->arrived, 1, __ATOMIC_ACQ_REL) ==
+	    (uint32_t)l->nprocs) {
+		l->release = now + LAUNCH_LEAD;
+		__atomic_store_n(&l->go, 1, __ATOMIC_RELEASE);
+		syscall(SYS_futex, &l->go, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+		printf("Launch: %d timers ready in %.3f ms (fan-out %d), "
+		    "starting %s %.3f ms later\n", l->nprocs,
+		    (double)(now - l->start) / 1e6,
+		    launch_fanout > 0 ? launch_fanout : l->nprocs,
+		    phase_names[launch_phase], (double)LAUNCH_LEAD / 1e6);
+		fflush(stdout);
+		return;
+	}
+
+	while (!__atomic_load_n(&l->go, __ATOMIC_ACQUIRE) && !stop_requested)
+		syscall(SYS_futex, &l->go, FUTEX_WAIT, 0, NULL, NULL, 0);
+}
+
+/* Start of the schedule of st: the release plus its phase offset. */
+static uint64_t
+launch_start(const struct timer_state *st)
+{
+	unsigned int seed;
+
+	switch (launch_phase) {
+	case PHASE_STAGGER:
+		return launch->release +
+		    st->sched_period * st->index / launch->nprocs;
+	case PHASE_RANDOM:
+		seed = getpid() + st->index;
+		return launch->release + rand_r(&seed) % st->sched_period;
+	}
+
+	return launch->release;
+}
+
+static int
+cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Keep the first tick of st. The last timer to get one prints how late
+ * the first ticks were against their ideal times, and how far apart
+ * they landed.
+ */
+static void
+launch_first(struct timer_state *st, uint64_t now)
+{
+	struct launch *l = launch;
+	struct launch_proc *p = &l->procs[st->index];
+	uint64_t lo, hi;
+	int64_t *late;
+	int i, n;
+
+	if (p->first != 0)
+		return;
+	p->first_late = (int64_t)(now - st->sched_start - st->sched_period);
+	p->first = now;
+	if (__atomic_add_fetch(&l->firsts, 1, __ATOMIC_ACQ_REL) !=
+	    (uint32_t)l->nprocs)
+		return;
+
+	n = l->nprocs;
+	late = malloc(n * sizeof(*late));
+	if (late == NULL)
+		return;
+	lo = UINT64_MAX;
+	hi = 0;
+	for (i = 0; i < n; i++) {
+		late[i] = __atomic_load_n(&l->procs[i].first_late,
+		    __ATOMIC_RELAXED);
+		if (l->procs[i].first < lo)
+			lo = l->procs[i].first;
+		if (l->procs[i].first > hi)
+			hi = l->procs[i].first;
+	}
+	qsort(late, n, sizeof(*late), cmp_int64);
+
+	printf("Phase: %s, first tick late min: %.3f, p50: %.3f, "
+	    "p99: %.3f, max: %.3f, spread: %.3f us\n",
+	    phase_names[launch_phase], late[0] / 1e3, late[n / 2] / 1e3,
+	    late[(n * 99 + 99) / 100 - 1] / 1e3, late[n - 1] / 1e3,
+	    (double)(hi - lo) / 1e3);
+	fflush(stdout);
+	free(late);
+}
+
+/* Simulate work done per tick, if --yield was given. */
+static inline void
+iter_yield(void)
+{
+	struct timespec stime;
+
+	if (yieldtime == -1 || random() % 10000 >= yieldpct * 100)
+		return;
+
+	stime.tv_sec = yieldtime / 1000000;
+	stime.tv_nsec = (yieldtime % 1000000) * 1000;
+	nanosleep(&stime, NULL);
+}
+
+/*
+ * Account for one tick stamped at curr_time, which the timer says came
+ * overrun expiries late. Never called from signal context; the signal
+ * handler only queues the tick.
+ *
+ * Lateness is measured against the ideal schedule rather than the
+ * previous tick. Expiries the timer overran are charged the lateness
+ * they would have seen had they been served now, so the lateness
+ * percentiles are free of coordinated omission.
+ */
+static void
+iter_update(struct timer_state *st, uint64_t curr_time, uint32_t overrun)
+{
+	uint64_t gap, late, ideal, dropped;
+	uint32_t o;
+	struct proc_sample end;
+
+	if (st->trace != NULL)
+		trace_record(st->trace, curr_time, overrun,
+		    __atomic_load_n(&st->ring.dropped, __ATOMIC_RELAXED));
+
+	if (st->count == 0) {
+		/* Reset all tracking variables. */
+		st->gaps = 0;
+		st->gaps_sq = 0;
+		st->min = UINT64_MAX;
+		st->max = 0;
+		st->overruns = 0;
+		hist_reset(&st->win_hist);
+		hist_reset(&st->win_late_hist);
+		st->use_proc_stat = !st->offline &&
+		    proc_sample(&st->sampler,
+		    st->cpu >= 0 ? st->cpu : sched_getcpu(),
+		    &st->sample_start) == 0;
+		if (st->spikes != NULL && !st->offline)
+			getrusage(RUSAGE_THREAD, &st->ru_start);
+		if (st->load != NULL) {
+			st->load->start_units = st->load->units;
+			st->load->start_time = curr_time;
+		}
+	}
+
+	/* The first gap is measured from when the timer was armed. */
+	if (st->last_time == 0) {
+		st->last_time = st->sched_start;
+		if (launch != NULL)
+			launch_first(st, curr_time);
+	}
+
+	late = 0;
+	for (o = 0; o <= overrun; o++) {
+		st->tick_seq++;
+		ideal = st->sched_start + st->tick_seq * st->sched_period;
+		late = curr_time > ideal ? curr_time - ideal : 0;
+		hist_record(&st->win_late_hist, late);
+		hist_record(&st->run_late_hist, late);
+	}
+	st->overruns += overrun;
+	st->run_overruns += overrun;
+
+	gap = curr_time - st->last_time;
+	gap = gap > clock_overhead ? gap - clock_overhead : 0;
+	st->gaps += gap;
+	st->gaps_sq += (double)gap * (double)gap;
+	st->count++;
+
+	if (gap > st->max)
+		st->max = gap;
+	if (gap < st->min)
+		st->min = gap;
+
+	hist_record(&st->win_hist, gap);
+	hist_record(&st->run_hist, gap);
+
+	if (gap > spike_threshold && st->spikes != NULL)
+		spike_capture(st, curr_time, gap, late);
+
+	st->last_time = curr_time;
+
+	if (st->count == iters) {
+		double std_dev;
+		uint64_t elapsed_hz;
+		struct proc_sample *start = &st->sample_start;
+		struct timer_report r;
+
+		/*
+		 * Steal, irq and softirq time of the CPU the interval
+		 * started on (the pinned one, if any).
+		 */
+		memset(&end, 0, sizeof(end));
+		if (!st->use_proc_stat ||
+		    proc_sample(&st->sampler, start->cpu, &end) != 0 ||
+		    end.cpu != start->cpu)
+			end = *start;
+		elapsed_hz = total_proc_stat_time(&end.stat) -
+		    total_proc_stat_time(&start->stat);
+
+		std_dev = sqrt((double)st->count * st->gaps_sq -
+		    (double)st->gaps * (double)st->gaps);
+		std_dev /= (double)st->count;
+		std_dev = NS_TO_US(std_dev);
+#define HZ_PCT(f)	(elapsed_hz == 0 ? -0.1 : \
+		    (double)(end.stat.f - start->stat.f) / elapsed_hz * 100.0)
+		r.steal_pct = HZ_PCT(steal);
+		r.irq_pct = HZ_PCT(irq);
+		r.softirq_pct = HZ_PCT(softirq);
+#undef HZ_PCT
+		r.irqs = end.irqs - start->irqs;
+		r.softirqs = end.softirqs - start->softirqs;
+		r.rq_wait = end.wait_ns - start->wait_ns;
+
+		hist_percentiles(&st->win_hist, report_pcts, NUM_REPORT_PCTS,
+		    r.pv);
+		hist_percentiles(&st->win_late_hist, report_pcts,
+		    NUM_REPORT_PCTS, r.lv);
+
+		dropped = __atomic_load_n(&st->ring.dropped, __ATOMIC_RELAXED);
+		st->last_cpu = st->offline ? st->cpu : sched_getcpu();
+
+		r.t = curr_time;
+		r.pid = st->tid;
+		r.index = st->index;
+		r.cpu = st->last_cpu;
+		r.backend = st->backend;
+		r.count = st->count;
+		r.min = st->min;
+		r.max = st->max;
+		r.avg = NS_TO_US(st->gaps) / (double)st->count;
+		r.dev = std_dev;
+		r.late_max = st->win_late_hist.max;
+		r.lost = dropped - st->last_dropped;
+		r.dropped = st->overruns;
+		perf_read(&st->perf, r.perf);
+		r.load_rate = 0.0;
+		if (st->load != NULL && curr_time > st->load->start_time)
+			r.load_rate = (double)(st->load->units -
+			    st->load->start_units) /
+			    ((double)(curr_time - st->load->start_time) / 1e9) /
+			    load_kernels[cpu_load].scale;
+		if (st->spikes != NULL)
+			spike_flush(st);
+		timer_report_publish(st, &r);
+		if (cgroup_root != NULL && st->slot == NULL && st->index == 0)
+			cgroup_report(curr_time);
+
+		st->last_dropped = dropped;
+		st->count = 0;
+	}
+}
+
+/*
+ * Signals queued for this user and RLIMIT_SIGPENDING, from the SigQ
+ * line of /proc/self/status. -1 if unknown.
+ */
+static void
+sigq_read(int fd, int64_t *cur, int64_t *max)
+{
+	char buf[4096], *p;
+	ssize_t n;
+
+	*cur = *max = -1;
+	if (fd == -1 || (n = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0)
+		return;
+	buf[n] = '\0';
+	p = strstr(buf, "\nSigQ:");
+	if (p != NULL)
+		sscanf(p + 6, "%" SCNd64 "/%" SCNd64, cur, max);
+}
+
+/*
+ * Report every class of --timers-per-proc for this interval, or with
+ * total for the whole run. Sent through the arena like spikes.
+ */
+static void
+class_flush(struct timer_state *st, uint64_t now, int total)
+{
+	struct timer_class *c;
+	struct report rep;
+	struct class_report *r = &rep.klass;
+	int i;
+
+	for (i = 0; i < ntimer_classes; i++) {
+		c = &st->classes[i];
+
+		memset(&rep, 0, sizeof(rep));
+		rep.kind = SLOT_CLASS;
+		r->t = now;
+		r->pid = st->tid;
+		r->index = st->index;
+		r->cls = i;
+		r->ntimers = c->ntimers;
+		r->total = total;
+		r->period = c->period;
+		r->count = total ? c->run.total : c->win.total;
+		r->dropped = total ? c->run_overruns : c->overruns;
+		hist_percentiles(total ? &c->run : &c->win, report_pcts,
+		    NUM_REPORT_PCTS, r->pv);
+		hist_percentiles(total ? &c->run_late : &c->win_late,
+		    report_pcts, NUM_REPORT_PCTS, r->lv);
+		r->max = total ? c->run.max : c->win.max;
+		r->late_max = total ? c->run_late.max : c->win_late.max;
+		sigq_read(st->status_fd, &r->sigq, &r->sigq_max);
+
+		if (st->slot == NULL)
+			class_report_print(r);
+		else
+			report_ring_push(&st->slot->ring, &rep);
+
+		hist_reset(&c->win);
+		hist_reset(&c->win_late);
+		c->overruns = 0;
+	}
+}
+
+/*
+ * Parse --timer-freqs, a list of periods in us with an optional
+ * "random:" prefix. Returns the number of classes, or -1.
+ */
+static int
+parse_timer_freqs(const char *list)
+{
+	const char *p;
+	char *end;
+	long v;
+	int n;
+
+	p = list;
+	if (strncmp(p, "random:", 7) == 0) {
+		timer_class_random = 1;
+		p += 7;
+	}
+
+	n = 0;
+	while (*p != '\0') {
+		v = strtol(p, &end, 10);
+		if (end == p || v <= 0 || v > INT_MAX / 1000 ||
+		    n == MAX_TIMER_CLASSES)
+			return -1;
+		timer_class_us[n++] = v;
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		p = end;
+	}
+
+	return n > 0 ? n : -1;
+}
+
+/*
+ * Every POSIX timer keeps a preallocated signal charged to
+ * RLIMIT_SIGPENDING, so raise it as far as allowed for all the timers.
+ */
+static void
+subtimers_limit(int nprocs)
+{
+	struct rlimit rl;
+	rlim_t want;
+	int i;
+
+	want = (rlim_t)nprocs * timers_per_proc + 1024;
+	if (getrlimit(RLIMIT_SIGPENDING, &rl) == 0 && rl.rlim_cur < want) {
+		rl.rlim_cur = rl.rlim_max < want ? rl.rlim_max : want;
+		setrlimit(RLIMIT_SIGPENDING, &rl);
+		getrlimit(RLIMIT_SIGPENDING, &rl);
+	}
+
+	printf("Timers: %d per proc, %s classes", timers_per_proc,
+	    timer_class_random ? "random" : "round-robin");
+	for (i = 0; i < ntimer_classes; i++)
+		printf("%s%d", i == 0 ? " " : ",", timer_class_us[i]);
+	printf(" us, RLIMIT_SIGPENDING: %lu", (unsigned long)rl.rlim_cur);
+	if (rl.rlim_cur < want)
+		printf(" (want %lu)", (unsigned long)want);
+	printf("\n");
+	fflush(stdout);
+}
+
+/* Set up the timers of --timers-per-proc; subtimers_arm() starts them. */
+static void
+subtimers_init(struct timer_state *st)
+{
+	struct subtimer *sub;
+	int i, *seen;
+
+	st->nsubs = timers_per_proc;
+	st->classes = calloc(ntimer_classes, sizeof(*st->classes));
+	seen = calloc(ntimer_classes, sizeof(*seen));
+	if (posix_memalign((void **)&st->subs, 64,
+	    st->nsubs * sizeof(*st->subs)) != 0 || st->classes == NULL ||
+	    seen == NULL) {
+		fprintf(stderr, "Failed to allocate timers\n");
+		exit(1);
+	}
+	memset(st->subs, 0, st->nsubs * sizeof(*st->subs));
+
+	for (i = 0; i < ntimer_classes; i++) {
+		st->classes[i].period = (uint64_t)timer_class_us[i] * 1000;
+		hist_reset(&st->classes[i].win);
+		hist_reset(&st->classes[i].win_late);
+		hist_reset(&st->classes[i].run);
+		hist_reset(&st->classes[i].run_late);
+	}
+
+	srandom(getpid() + st->index);
+	for (i = 0; i < st->nsubs; i++) {
+		sub = &st->subs[i];
+		sub->st = st;
+		sub->cls = timer_class_random ? random() % ntimer_classes :
+		    i % ntimer_classes;
+		sub->period = st->classes[sub->cls].period;
+		st->classes[sub->cls].ntimers++;
+	}
+
+	/* start holds the phase until subtimers_arm(). */
+	for (i = 0; i < st->nsubs; i++) {
+		sub = &st->subs[i];
+		sub->start = sub->period * seen[sub->cls]++ /
+		    st->classes[sub->cls].ntimers;
+	}
+	free(seen);
+
+	st->status_fd = open("/proc/self/status", O_RDONLY|O_CLOEXEC);
+}
+
+/*
+ * Account a tick of one of the timers: in its class, then through
+ * iter_update() on the timer's own schedule, which keeps the proc's T>
+ * line covering all of them.
+ */
+static void
+subtimer_update(struct timer_state *st, struct subtimer *sub,
+    uint64_t stamp, uint32_t overrun)
+{
+	struct timer_class *c = &st->classes[sub->cls];
+	uint64_t gap, late, ideal;
+	uint32_t o;
+
+	for (o = 0; o <= overrun; o++) {
+		ideal = sub->start + (sub->seq + o + 1) * sub->period;
+		late = stamp > ideal ? stamp - ideal : 0;
+		hist_record(&c->win_late, late);
+		hist_record(&c->run_late, late);
+	}
+	c->overruns += overrun;
+	c->run_overruns += overrun;
+
+	gap = stamp - (sub->last_time != 0 ? sub->last_time : sub->start);
+	gap = gap > clock_overhead ? gap - clock_overhead : 0;
+	hist_record(&c->win, gap);
+	hist_record(&c->run, gap);
+
+	st->sched_start = sub->start;
+	st->sched_period = sub->period;
+	st->tick_seq = sub->seq;
+	st->last_time = sub->last_time;
+	iter_update(st, stamp, overrun);
+	sub->seq = st->tick_seq;
+	sub->last_time = st->last_time;
+
+	/* iter_update() just reported the interval. */
+	if (st->count == 0)
+		class_flush(st, stamp, 0);
+}
+
+/* Process every tick queued by the signal handler. */
+static inline void
+drain_ticks(struct timer_state *st)
+{
+	struct tick t;
+
+	while (tick_ring_pop(&st->ring, &t)) {
+		if (st->subs != NULL)
+			subtimer_update(st, &st->subs[t.timer], t.stamp,
+			    t.overrun);
+		else
+			iter_update(st, t.stamp, t.overrun);
+		iter_yield();
+	}
+}
+
+/* The timer's sigev_value points at the timer_state it belongs to. */
+static void
+handle_sig(int sig, siginfo_t *info, void *ctxt)
+{
+	struct timer_state *st = info->si_value.sival_ptr;
+	uint64_t now;
+	int overrun;
+
+	now = get_time();
+	overrun = timer_getoverrun(st->timer);
+
+	tick_ring_push(&st->ring, now, overrun > 0 ? overrun : 0, 0);
+}
+
+/* With --timers-per-proc it points at the timer's struct subtimer. */
+static void
+handle_sig_multi(int sig, siginfo_t *info, void *ctxt)
+{
+	struct subtimer *sub = info->si_value.sival_ptr;
+	struct timer_state *st = sub->st;
+
+	tick_ring_push(&st->ring, get_time(),
+	    info->si_overrun > 0 ? info->si_overrun : 0, sub - st->subs);
+}
+
+static void
+handle_stop(int sig)
+{
+
+	stop_requested = 1;
+}
+
+/*
+ * Parse a list like "0-3,8,10-11" into cpus[]. Returns the number of
+ * CPUs, or -1 if the list is malformed.
+ */
+static int
+parse_cpu_list(const char *list, int *cpus, int max)
+{
+	const char *p;
+	char *end;
+	long lo, hi;
+	int n;
+
+	n = 0;
+	p = list;
+	while (*p != '\0') {
+		lo = strtol(p, &end, 10);
+		if (end == p || lo < 0)
+			return -1;
+		hi = lo;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+			if (end == p || hi < lo)
+				return -1;
+		}
+		for (; lo <= hi; lo++) {
+			if (n == max)
+				return -1;
+			cpus[n++] = lo;
+		}
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		p = end;
+	}
+
+	return n;
+}
+
+static void
+pin_to_cpu(struct timer_state *st)
+{
+	cpu_set_t set;
+
+	if (st->cpu == -1)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(st->cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		fprintf(stderr, "Failed to pin timer %d to CPU %d: %s\n",
+		    st->index, st->cpu, strerror(errno));
+		exit(1);
+	}
+}
+
+/*
+ * Real-time and power settings for the timers: --sched, --mlockall,
+ * --prefault and --dma-latency. The scheduling policy is applied per
+ * timer thread after pinning; the memory settings per process. The
+ * PM QoS request on /dev/cpu_dma_latency is made once by main() and
+ * holds for as long as the fd stays open, i.e. the whole run.
+ */
+static void
+prefault_stack(void)
+{
+	volatile char buf[PREFAULT_STACK];
+	size_t i;
+
+	for (i = 0; i < sizeof(buf); i += 4096)
+		buf[i] = 0;
+}
+
+static void
+rt_apply(struct timer_state *st)
+{
+	struct sched_param param;
+	struct dl_sched_attr attr;
+	int policy, ret;
+
+	if (use_mlockall && mlockall(MCL_CURRENT|MCL_FUTURE) != 0) {
+		fprintf(stderr, "mlockall failed: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	if (use_prefault)
+		prefault_stack();
+
+	policy = sched_policies[sched_pol].policy;
+	if (policy == SCHED_OTHER)
+		return;
+
+	if (policy == SCHED_DEADLINE) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.sched_policy = SCHED_DEADLINE;
+		attr.sched_period = st->sched_period;
+		attr.sched_deadline = st->sched_period;
+		attr.sched_runtime = sched_runtime != 0 ?
+		    (uint64_t)sched_runtime * 1000 : st->sched_period / 4;
+		ret = syscall(SYS_sched_setattr, 0, &attr, 0) == 0 ? 0 : errno;
+	} else {
+		param.sched_priority = sched_prio;
+		ret = pthread_setschedparam(pthread_self(), policy, &param);
+	}
+
+	if (ret != 0) {
+		fprintf(stderr, "Failed to set timer %d to %s: %s\n",
+		    st->index, sched_policies[sched_pol].name, strerror(ret));
+		exit(1);
+	}
+}
+
+/* Hold the CPU wakeup latency at dma_latency us for the run. */
+static void
+dma_latency_hold(void)
+{
+	int32_t val = dma_latency;
+	int fd;
+
+	fd = open("/dev/cpu_dma_latency", O_WRONLY|O_CLOEXEC);
+	if (fd == -1 || write(fd, &val, sizeof(val)) != sizeof(val)) {
+		fprintf(stderr, "Failed to set /dev/cpu_dma_latency: %s\n",
+		    strerror(errno));
+		exit(1);
+	}
+	/* Deliberately left open. */
+}
+
+static void
+rt_print(void)
+{
+
+	printf("Run: Sched: %s", sched_policies[sched_pol].name);
+	if (sched_policies[sched_pol].policy == SCHED_FIFO ||
+	    sched_policies[sched_pol].policy == SCHED_RR)
+		printf(" (prio %d)", sched_prio);
+	else if (sched_policies[sched_pol].policy == SCHED_DEADLINE)
+		printf(" (runtime %d us)", sched_runtime != 0 ?
+		    sched_runtime : timerfreq / 4);
+	printf(", Mlockall: %s, Prefault: %s, DMA latency: ",
+	    use_mlockall ? "on" : "off", use_prefault ? "on" : "off");
+	if (dma_latency == -1)
+		printf("default\n");
+	else
+		printf("%d us\n", dma_latency);
+	fflush(stdout);
+}
+
+/*
+ * Start the ideal schedule now, or with --phase sleep until its start
+ * after the release. sched_start is on the clock we read and sched_base
+ * on the clock timers and sleeps run off; they only differ for the raw
+ * and tsc sources.
+ */
+static void
+sched_begin(struct timer_state *st)
+{
+	struct timespec tv;
+	uint64_t now;
+
+	clock_gettime(clock_srcs[clock_src].timer_id, &tv);
+	now = get_time();
+	st->sched_start = launch != NULL ? launch_start(st) : now;
+	if (clock_srcs[clock_src].id == clock_srcs[clock_src].timer_id)
+		st->sched_base = st->sched_start;
+	else
+		st->sched_base = (uint64_t)tv.tv_sec * 1000000000ULL +
+		    tv.tv_nsec + (st->sched_start - now);
+
+	if (launch != NULL) {
+		ns_to_timespec(st->sched_base, &tv);
+		while (clock_nanosleep(clock_srcs[clock_src].timer_id,
+		    TIMER_ABSTIME, &tv, NULL) == EINTR && !stop_requested)
+			;
+	}
+
+	if (st->trace != NULL)
+		st->trace->hdr->sched_start = st->sched_start;
+}
+
+/* Absolute deadline of tick n, on the timer clock. */
+static inline void
+sched_deadline(struct timer_state *st, uint64_t n, struct timespec *ts)
+{
+
+	ns_to_timespec(st->sched_base + n * st->sched_period, ts);
+}
+
+/*
+ * Tick delivery backends. Each one arms its own wakeup source on the
+ * ideal schedule, then loops until a stop is requested feeding every
+ * wakeup to iter_update().
+ */
+
+/*
+ * Create and start the --timers-per-proc timers from the sevt template,
+ * each on its own phase of the schedule sched_begin() just started.
+ */
+static int
+subtimers_arm(struct timer_state *st, struct sigevent *sevt)
+{
+	struct subtimer *sub;
+	struct itimerspec ts;
+	struct rlimit rl;
+	int i;
+
+	for (i = 0; i < st->nsubs; i++) {
+		sub = &st->subs[i];
+		sevt->sigev_value.sival_ptr = sub;
+		if (timer_create(clock_srcs[clock_src].timer_id, sevt,
+		    &sub->timer) != 0) {
+			getrlimit(RLIMIT_SIGPENDING, &rl);
+			fprintf(stderr, "timer_create failed after %d timers: "
+			    "%s (RLIMIT_SIGPENDING %lu)\n", i,
+			    strerror(errno), (unsigned long)rl.rlim_cur);
+			while (i-- > 0)
+				timer_delete(st->subs[i].timer);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < st->nsubs; i++) {
+		sub = &st->subs[i];
+		ns_to_timespec(st->sched_base + sub->start + sub->period,
+		    &ts.it_value);
+		ns_to_timespec(sub->period, &ts.it_interval);
+		sub->start += st->sched_start;
+		timer_settime(sub->timer, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	return 0;
+}
+
+/*
+ * POSIX timer signal. In --threads mode the signal goes to the calling
+ * thread only. MYSIG must already have a handler installed.
+ */
+static int
+tick_signal_run(struct timer_state *st)
+{
+	struct sigevent sevt;
+	struct itimerspec ts;
+	sigset_t block_mask, wait_mask;
+	int i;
+
+	if (!use_busyloop) {
+		sigemptyset(&block_mask);
+		sigaddset(&block_mask, MYSIG);
+		pthread_sigmask(SIG_BLOCK, &block_mask, &wait_mask);
+		sigdelset(&wait_mask, MYSIG);
+	}
+
+	memset(&sevt, 0, sizeof(sevt));
+	if (use_threads) {
+		sevt.sigev_notify = SIGEV_THREAD_ID;
+		sevt.sigev_notify_thread_id = st->tid;
+	} else
+		sevt.sigev_notify = SIGEV_SIGNAL;
+	sevt.sigev_signo = MYSIG;
+	sevt.sigev_value.sival_ptr = st;
+
+	if (st->subs != NULL) {
+		sched_begin(st);
+		if (subtimers_arm(st, &sevt) != 0)
+			return 1;
+	} else {
+		if (timer_create(clock_srcs[clock_src].timer_id, &sevt,
+		    &st->timer) != 0) {
+			perror("timer_create");
+			return 1;
+		}
+
+		sched_begin(st);
+		sched_deadline(st, 1, &ts.it_value);
+		ns_to_timespec(st->sched_period, &ts.it_interval);
+		timer_settime(st->timer, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	/* Work loop. */
+	while (!stop_requested) {
+		drain_ticks(st);
+
+		if (st->load != NULL)
+			st->load->units += load_kernels[cpu_load].run(st->load);
+		else if (!use_busyloop)
+			/* MYSIG is blocked outside of here, so a tick that
+			 * lands after the drain still wakes us.
+			 */
+			sigsuspend(&wait_mask);
+	}
+
+	if (st->subs != NULL)
+		for (i = 0; i < st->nsubs; i++)
+			timer_delete(st->subs[i].timer);
+	else
+		timer_delete(st->timer);
+
+	return 0;
+}
+
+/* Relative nanosleep() loop. Drifts by the loop's own overhead. */
+static int
+tick_sleep_run(struct timer_state *st)
+{
+	struct timespec freq_ts;
+	uint64_t now;
+
+	ns_to_timespec(st->sched_period, &freq_ts);
+
+	sched_begin(st);
+	while (1) {
+		nanosleep(&freq_ts, NULL);
+
+		if (stop_requested)
+			break;
+
+		now = get_time();
+		iter_update(st, now, sched_missed(st, now));
+	}
+
+	return 0;
+}
+
+/* clock_nanosleep() to the absolute deadline of the next tick. */
+static int
+tick_abs_sleep_run(struct timer_state *st)
+{
+	struct timespec deadline;
+	uint64_t now;
+
+	sched_begin(st);
+	while (!stop_requested) {
+		sched_deadline(st, st->tick_seq + 1, &deadline);
+		if (clock_nanosleep(clock_srcs[clock_src].timer_id,
+		    TIMER_ABSTIME, &deadline, NULL) != 0)
+			continue;
+
+		now = get_time();
+		iter_update(st, now, sched_missed(st, now));
+		iter_yield();
+	}
+
+	return 0;
+}
+
+/*
+ * timerfd, either blocking in read() or, with use_epoll, in
+ * epoll_wait() first. The expiration count read back gives overruns.
+ */
+static int
+tick_timerfd_common(struct timer_state *st, int use_epoll)
+{
+	struct itimerspec ts;
+	struct epoll_event ev;
+	uint64_t expirations, now;
+	int tfd, efd;
+
+	tfd = timerfd_create(clock_srcs[clock_src].timer_id, TFD_CLOEXEC);
+	if (tfd == -1) {
+		perror("timerfd_create");
+		return 1;
+	}
+
+	efd = -1;
+	if (use_epoll) {
+		efd = epoll_create1(EPOLL_CLOEXEC);
+		if (efd == -1) {
+			perror("epoll_create1");
+			return 1;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		if (epoll_ctl(efd, EPOLL_CTL_ADD, tfd, &ev) != 0) {
+			perror("epoll_ctl");
+			return 1;
+		}
+	}
+
+	sched_begin(st);
+	sched_deadline(st, 1, &ts.it_value);
+	ns_to_timespec(st->sched_period, &ts.it_interval);
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &ts, NULL) != 0) {
+		perror("timerfd_settime");
+		return 1;
+	}
+
+	while (!stop_requested) {
+		if (efd != -1) {
+			if (epoll_wait(efd, &ev, 1, -1) != 1)
+				continue;
+			/* Stamp the wakeup, not the read that follows. */
+			now = get_time();
+			if (read(tfd, &expirations, sizeof(expirations)) !=
+			    sizeof(expirations))
+				continue;
+		} else {
+			if (read(tfd, &expirations, sizeof(expirations)) !=
+			    sizeof(expirations))
+				continue;
+			now = get_time();
+		}
+
+		iter_update(st, now, expirations - 1);
+		iter_yield();
+	}
+
+	if (efd != -1)
+		close(efd);
+	close(tfd);
+
+	return 0;
+}
+
+static int
+tick_timerfd_run(struct timer_state *st)
+{
+
+	return tick_timerfd_common(st, 0);
+}
+
+static int
+tick_timerfd_epoll_run(struct timer_state *st)
+{
+
+	return tick_timerfd_common(st, 1);
+}
+
+/*
+ * --wakeup-test: instead of waiting for a timer, each tick is a round
+ * trip to a partner thread (with --threads) or process. On its ideal
+ * schedule the timer stamps, wakes the partner over the mechanism of
+ * its backend, and waits to be woken back. The gap it accounts is that
+ * round trip, so every report, histogram and CSV column of a timer run
+ * applies; the lateness is the answer's against the schedule, i.e. the
+ * sleep's own lateness plus the round trip. --wakeup-cpu places the
+ * partner relative to the timer's CPU using the sysfs topology.
+ */
+enum { WAKE_SAME, WAKE_SMT, WAKE_SOCKET, WAKE_CROSS, NUM_WAKE_PLACE };
+
+static const char *const wake_places[NUM_WAKE_PLACE] = {
+	[WAKE_SAME]	= "same",
+	[WAKE_SMT]	= "smt",
+	[WAKE_SOCKET]	= "socket",
+	[WAKE_CROSS]	= "cross",
+};
+
+static int wakeup_place = -1;		/* -1: leave it to the scheduler. */
+static cpu_set_t wakeup_cpus;		/* CPUs a partner may go on. */
+
+enum { WAKE_PING, WAKE_PONG };
+
+/* Shared with the partner; the futex and condvar state must be too. */
+struct wakeup_pair {
+	int		backend;
+	int		cpu;		/* Partner CPU, or -1. */
+	int		fds[4];		/* Ping read, write; pong read, write. */
+	uint32_t	seq[2];		/* Last ping and pong sent. */
+	uint32_t	quit;
+	pthread_mutex_t	mtx;
+	pthread_cond_t	cv[2];
+};
+
+static int
+cpu_topology(int cpu, const char *name)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int v;
+
+	snprintf(path, sizeof(path),
+	    "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%d", &v) != 1)
+		v = -1;
+	fclose(f);
+
+	return v;
+}
+
+/* The next CPU after cpu placed as --wakeup-cpu asks, or -1. */
+static int
+wakeup_partner_cpu(int cpu)
+{
+	int c, i, core, pkg, ccore, cpkg;
+
+	if (wakeup_place == WAKE_SAME)
+		return cpu;
+
+	core = cpu_topology(cpu, "core_id");
+	pkg = cpu_topology(cpu, "physical_package_id");
+	for (i = 1; i < CPU_SETSIZE; i++) {
+		c = (cpu + i) % CPU_SETSIZE;
+		if (!CPU_ISSET(c, &wakeup_cpus))
+			continue;
+		ccore = cpu_topology(c, "core_id");
+		cpkg = cpu_topology(c, "physical_package_id");
+		if ((wakeup_place == WAKE_SMT && cpkg == pkg &&
+		    ccore == core) ||
+		    (wakeup_place == WAKE_SOCKET && cpkg == pkg &&
+		    ccore != core) ||
+		    (wakeup_place == WAKE_CROSS && cpkg != pkg))
+			return c;
+	}
+
+	return -1;
+}
+
+static void
+wakeup_send(struct wakeup_pair *w, int dir, uint32_t seq)
+{
+	uint64_t one = 1;
+
+	switch (w->backend) {
+	case TICK_FUTEX:
+		__atomic_store_n(&w->seq[dir], seq, __ATOMIC_RELEASE);
+		syscall(SYS_futex, &w->seq[dir], FUTEX_WAKE, 1, NULL, NULL, 0);
+		break;
+	case TICK_CONDVAR:
+		pthread_mutex_lock(&w->mtx);
+		w->seq[dir] = seq;
+		pthread_cond_signal(&w->cv[dir]);
+		pthread_mutex_unlock(&w->mtx);
+		break;
+	default:
+		/* An eventfd takes 8 bytes, pipes and sockets one. */
+		while (write(w->fds[dir * 2 + 1], &one,
+		    w->backend == TICK_EVENTFD ? 8 : 1) == -1 &&
+		    errno == EINTR)
+			;
+	}
+}
+
+static void
+wakeup_recv(struct wakeup_pair *w, int dir, uint32_t seq)
+{
+	uint64_t buf;
+	uint32_t v;
+
+	switch (w->backend) {
+	case TICK_FUTEX:
+		while ((v = __atomic_load_n(&w->seq[dir], __ATOMIC_ACQUIRE)) !=
+		    seq)
+			syscall(SYS_futex, &w->seq[dir], FUTEX_WAIT, v, NULL,
+			    NULL, 0);
+		break;
+	case TICK_CONDVAR:
+		pthread_mutex_lock(&w->mtx);
+		while (w->seq[dir] != seq)
+			pthread_cond_wait(&w->cv[dir], &w->mtx);
+		pthread_mutex_unlock(&w->mtx);
+		break;
+	default:
+		while (read(w->fds[dir * 2], &buf,
+		    w->backend == TICK_EVENTFD ? 8 : 1) == -1 &&
+		    errno == EINTR)
+			;
+	}
+}
+
+static struct wakeup_pair *
+wakeup_pair_create(int backend)
+{
+	struct wakeup_pair *w;
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t cattr;
+	int sv[2], ret;
+
+	w = mmap(NULL, sizeof(*w), PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (w == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	w->backend = backend;
+	w->fds[0] = w->fds[1] = w->fds[2] = w->fds[3] = -1;
+
+	ret = 0;
+	switch (backend) {
+	case TICK_EVENTFD:
+		w->fds[0] = w->fds[1] = eventfd(0, EFD_CLOEXEC);
+		w->fds[2] = w->fds[3] = eventfd(0, EFD_CLOEXEC);
+		ret = w->fds[0] == -1 || w->fds[2] == -1 ? -1 : 0;
+		break;
+	case TICK_PIPE:
+		ret = pipe2(&w->fds[0], O_CLOEXEC) == 0 &&
+		    pipe2(&w->fds[2], O_CLOEXEC) == 0 ? 0 : -1;
+		break;
+	case TICK_UNIX:
+		ret = socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, sv);
+		w->fds[0] = w->fds[3] = sv[1];
+		w->fds[1] = w->fds[2] = sv[0];
+		break;
+	case TICK_CONDVAR:
+		pthread_mutexattr_init(&mattr);
+		pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+		pthread_mutex_init(&w->mtx, &mattr);
+		pthread_mutexattr_destroy(&mattr);
+		pthread_condattr_init(&cattr);
+		pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+		pthread_cond_init(&w->cv[0], &cattr);
+		pthread_cond_init(&w->cv[1], &cattr);
+		pthread_condattr_destroy(&cattr);
+		break;
+	}
+	if (ret != 0) {
+		fprintf(stderr, "Failed to set up %s: %s\n",
+		    tick_backends[backend].name, strerror(errno));
+		return NULL;
+	}
+
+	return w;
+}
+
+static void
+wakeup_pair_destroy(struct wakeup_pair *w)
+{
+	int i, j;
+
+	/* eventfds and the socketpair appear twice in fds[]. */
+	for (i = 0; i < 4; i++) {
+		for (j = 0; j < i; j++)
+			if (w->fds[j] == w->fds[i])
+				break;
+		if (w->fds[i] != -1 && j == i)
+			close(w->fds[i]);
+	}
+	munmap(w, sizeof(*w));
+}
+
+/* The partner: answer every ping until told to quit. */
+static void *
+wakeup_partner(void *arg)
+{
+	struct wakeup_pair *w = arg;
+	cpu_set_t set;
+	uint32_t seq;
+
+	if (w->cpu != -1) {
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	for (seq = 1;; seq++) {
+		wakeup_recv(w, WAKE_PING, seq);
+		if (__atomic_load_n(&w->quit, __ATOMIC_ACQUIRE))
+			break;
+		wakeup_send(w, WAKE_PONG, seq);
+	}
+
+	return NULL;
+}
+
+static int
+tick_wakeup_run(struct timer_state *st)
+{
+	struct wakeup_pair *w;
+	struct timespec deadline;
+	pthread_t thr;
+	uint64_t now, t0;
+	uint32_t seq;
+	pid_t pid;
+	int ret;
+
+	w = wakeup_pair_create(st->backend);
+	if (w == NULL)
+		return 1;
+
+	w->cpu = -1;
+	if (wakeup_place != -1) {
+		/* The timer has to stay put for the placement to hold. */
+		if (st->cpu == -1) {
+			st->cpu = sched_getcpu();
+			pin_to_cpu(st);
+		}
+		w->cpu = wakeup_partner_cpu(st->cpu);
+		if (w->cpu == -1) {
+			fprintf(stderr, "No CPU for a %s partner of CPU %d\n",
+			    wake_places[wakeup_place], st->cpu);
+			wakeup_pair_destroy(w);
+			return 1;
+		}
+	}
+	printf("Wakeup: timer %d on CPU %d, %s partner on CPU %d (%s)\n",
+	    st->index, st->cpu != -1 ? st->cpu : sched_getcpu(),
+	    tick_backends[st->backend].name, w->cpu,
+	    wakeup_place != -1 ? wake_places[wakeup_place] : "unpinned");
+	fflush(stdout);
+
+	pid = -1;
+	if (use_threads) {
+		ret = pthread_create(&thr, NULL, wakeup_partner, w);
+		if (ret != 0) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+			wakeup_pair_destroy(w);
+			return 1;
+		}
+	} else {
+		pid = fork();
+		if (pid == -1) {
+			perror("fork");
+			wakeup_pair_destroy(w);
+			return 1;
+		} else if (pid == 0) {
+			/* The timer stops it once its own stop is seen. */
+			signal(SIGINT, SIG_IGN);
+			signal(SIGTERM, SIG_IGN);
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			wakeup_partner(w);
+			_exit(0);
+		}
+	}
+
+	sched_begin(st);
+	seq = 1;
+	while (!stop_requested) {
+		sched_deadline(st, st->tick_seq + 1, &deadline);
+		if (clock_nanosleep(clock_srcs[clock_src].timer_id,
+		    TIMER_ABSTIME, &deadline, NULL) != 0)
+			continue;
+
+		t0 = get_time();
+		wakeup_send(w, WAKE_PING, seq);
+		wakeup_recv(w, WAKE_PONG, seq);
+		now = get_time();
+		seq++;
+
+		/* Make the gap iter_update() measures the round trip. */
+		if (st->tick_seq == 0 && launch != NULL)
+			launch_first(st, now);
+		st->last_time = t0;
+		iter_update(st, now, sched_missed(st, now));
+		iter_yield();
+	}
+
+	__atomic_store_n(&w->quit, 1, __ATOMIC_RELEASE);
+	wakeup_send(w, WAKE_PING, seq);
+	if (pid == -1)
+		pthread_join(thr, NULL);
+	else
+		waitpid(pid, NULL, 0);
+	wakeup_pair_destroy(w);
+
+	return 0;
+}
+
+static const struct tick_backend tick_backends[NUM_TICK] = {
+	[TICK_SIGNAL]		= { "signal", tick_signal_run },
+	[TICK_SLEEP]		= { "sleep", tick_sleep_run },
+	[TICK_ABS_SLEEP]	= { "abs-sleep", tick_abs_sleep_run },
+	[TICK_TIMERFD]		= { "timerfd", tick_timerfd_run },
+	[TICK_TIMERFD_EPOLL]	= { "timerfd-epoll", tick_timerfd_epoll_run },
+	[TICK_FUTEX]		= { "futex", tick_wakeup_run },
+	[TICK_EVENTFD]		= { "eventfd", tick_wakeup_run },
+	[TICK_PIPE]		= { "pipe", tick_wakeup_run },
+	[TICK_UNIX]		= { "unix", tick_wakeup_run },
+	[TICK_CONDVAR]		= { "condvar", tick_wakeup_run },
+};
+
+/* Run one timer until a stop is requested. */
+static int
+timer_run(struct timer_state *st)
+{
+	uint64_t period;
+	int ret;
+
+	st->tid = syscall(SYS_gettid);
+	pin_to_cpu(st);
+	rt_apply(st);
+	if (record_path != NULL)
+		st->trace = trace_open(st);
+	if (use_perf)
+		perf_open(&st->perf);
+	if (cpu_load != -1) {
+		st->load = calloc(1, sizeof(*st->load));
+		if (st->load == NULL) {
+			fprintf(stderr, "Failed to allocate memory\n");
+			exit(1);
+		}
+		if (load_kernels[cpu_load].init != NULL)
+			load_kernels[cpu_load].init(st->load);
+	}
+	proc_sampler_open(&st->sampler);
+	if (timers_per_proc > 1)
+		subtimers_init(st);
+
+	if (launch != NULL)
+		launch_wait(st);
+
+	period = st->sched_period;
+	ret = tick_backends[st->backend].run(st);
+	st->sched_period = period;
+
+	/* Hand the ticks of the partial last interval to the collector. */
+	if (st->spikes != NULL)
+		spike_flush(st);
+	if (st->subs != NULL)
+		class_flush(st, get_time(), 1);
+	if (st->slot != NULL)
+		timer_slot_sync(st);
+	if (st->trace != NULL) {
+		trace_close(st->trace);
+		st->trace = NULL;
+	}
+	perf_close(&st->perf);
+	proc_sampler_close(&st->sampler);
+	if (st->status_fd != -1) {
+		close(st->status_fd);
+		st->status_fd = -1;
+	}
+
+	return ret;
+}
+
+static void
+timer_dump_hists(struct timer_state *st)
+{
+	char path[PATH_MAX];
+
+	if (hist_dump == NULL)
+		return;
+
+	snprintf(path, sizeof(path), "%s.%d.hist", hist_dump, st->index);
+	hist_dump_file(&st->run_hist, path, st->index, "ns");
+	snprintf(path, sizeof(path), "%s.%d.late.hist", hist_dump, st->index);
+	hist_dump_file(&st->run_late_hist, path, st->index, "ns");
+}
+
+static void *
+timer_thread(void *arg)
+{
+	struct timer_state *st = arg;
+
+	if (timer_run(st) != 0)
+		exit(1);
+
+	return NULL;
+}
+
+enum { TABLE_BY_CPU, TABLE_BY_BACKEND };
+
+static inline int
+table_key(const struct timer_state *st, int by)
+{
+
+	if (by == TABLE_BY_BACKEND)
+		return st->backend;
+
+	return st->cpu != -1 ? st->cpu : st->last_cpu;
+}
+
+/*
+ * Merge the whole-run histograms of all threads per CPU, or per tick
+ * backend, and print one row each. Threads count against the CPU they
+ * are pinned to, or the CPU they were last seen on.
+ */
+static void
+print_jitter_table(struct timer_state **states, int nstates, int by)
+{
+	struct hist *gap_h, *late_h;
+	uint64_t pv[NUM_REPORT_PCTS], lv[NUM_REPORT_PCTS];
+	uint64_t overruns;
+	int i, key, key_max, nthr;
+
+	gap_h = malloc(sizeof(*gap_h));
+	late_h = malloc(sizeof(*late_h));
+	if (gap_h == NULL || late_h == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+
+	key_max = -1;
+	for (i = 0; i < nstates; i++)
+		if (table_key(states[i], by) > key_max)
+			key_max = table_key(states[i], by);
+
+	printf("\nPer-%s jitter (us):\n", by == TABLE_BY_CPU ? "CPU" :
+	    "backend");
+	printf("%-13s %7s %12s %10s %10s %10s %10s %10s %10s %10s %8s\n",
+	    by == TABLE_BY_CPU ? "CPU" : "Backend", "Threads", "Ticks",
+	    "Gap p50", "Gap p99", "Gap p99.9", "Gap max", "Late p99",
+	    "Late p99.9", "Late max", "Dropped");
+
+	for (key = -1; key <= key_max; key++) {
+		hist_reset(gap_h);
+		hist_reset(late_h);
+		overruns = 0;
+		nthr = 0;
+
+		for (i = 0; i < nstates; i++) {
+			if (table_key(states[i], by) != key)
+				continue;
+
+			hist_merge(gap_h, &states[i]->run_hist);
+			hist_merge(late_h, &states[i]->run_late_hist);
+			overruns += states[i]->run_overruns;
+			nthr++;
+		}
+
+		if (nthr == 0)
+			continue;
+
+		hist_percentiles(gap_h, report_pcts, NUM_REPORT_PCTS, pv);
+		hist_percentiles(late_h, report_pcts, NUM_REPORT_PCTS, lv);
+
+		if (by == TABLE_BY_CPU)
+			printf("%-13d", key);
+		else
+			printf("%-13s", tick_backends[key].name);
+		printf(" %7d %12" PRIu64 " %10.3f %10.3f %10.3f %10.3f "
+		    "%10.3f %10.3f %10.3f %8" PRIu64 "\n",
+		    nthr, gap_h->total,
+		    NS_TO_US(pv[0]), NS_TO_US(pv[2]), NS_TO_US(pv[3]),
+		    NS_TO_US(gap_h->max), NS_TO_US(lv[2]), NS_TO_US(lv[3]),
+		    NS_TO_US(late_h->max), overruns);
+	}
+	fflush(stdout);
+
+	free(gap_h);
+	free(late_h);
+}
+
+/*
+ * --sweep: run every combination of the swept settings for --sweep-time
+ * seconds each. Every cell is a fresh --aggregate run forked from the
+ * orchestrator, whose collector leaves its whole-cell percentiles in a
+ * shared result slot. The orchestrator prints a W> line per cell and,
+ * with --csv, writes the matrix to file.sweep.csv and file.sweep.json.
+ */
+enum {
+	SWEEP_FREQ,
+	SWEEP_NPROCS,
+	SWEEP_IO_PROCS,
+	SWEEP_MEM_PROCS,
+	SWEEP_YIELDPCT,
+	NUM_SWEEP,
+};
+
+#define SWEEP_MAX_VALUES	64
+#define SWEEP_MAX_CELLS		4096
+#define DFLT_SWEEP_TIME		10
+
+static struct sweep_axis {
+	const char	*name;		/* Option it stands in for. */
+	int		min, max;	/* Valid values. */
+	int		*var;		/* Set per cell, bound by main(). */
+	int		nvals;		/* Zero if not swept. */
+	int		vals[SWEEP_MAX_VALUES];
+} sweep_axes[NUM_SWEEP] = {
+	[SWEEP_FREQ] = { "freq", 1, INT_MAX, &timerfreq, 0, { 0 } },
+	[SWEEP_NPROCS] = { "nprocs", 1, CPU_SETSIZE, NULL, 0, { 0 } },
+	[SWEEP_IO_PROCS] = { "io-procs", 0, CPU_SETSIZE, NULL, 0, { 0 } },
+	[SWEEP_MEM_PROCS] = { "mem-procs", 0, CPU_SETSIZE, NULL, 0, { 0 } },
+	[SWEEP_YIELDPCT] = { "yieldpct", 0, 100, &yieldpct, 0, { 0 } },
+};
+
+struct sweep_result {
+	int		done;		/* Set by the cell's collector. */
+	uint64_t	ticks, dropped, lost;
+	uint64_t	pv[NUM_REPORT_PCTS], max;
+	uint64_t	lv[NUM_REPORT_PCTS], late_max;
+};
+
+static int nsweep_cells;		/* Zero without --sweep. */
+static int sweep_time = DFLT_SWEEP_TIME;
+static struct sweep_result *sweep_cell;	/* This cell's, in a cell. */
+
+/*
+ * Add one --sweep axis, <name>=<list>, where the list holds values and
+ * <lo>-<hi>[:<step>] ranges separated by commas. Returns -1 on error.
+ */
+static int
+sweep_add(const char *spec)
+{
+	struct sweep_axis *ax;
+	const char *p;
+	char *end;
+	long lo, hi, step;
+	size_t len;
+	int i;
+
+	p = strchr(spec, '=');
+	if (p == NULL)
+		return -1;
+	len = p - spec;
+	for (i = 0; i < NUM_SWEEP; i++)
+		if (strlen(sweep_axes[i].name) == len &&
+		    strncmp(spec, sweep_axes[i].name, len) == 0)
+			break;
+	if (i == NUM_SWEEP || sweep_axes[i].nvals != 0)
+		return -1;
+	ax = &sweep_axes[i];
+
+	do {
+		p++;
+		lo = strtol(p, &end, 10);
+		if (end == p)
+			return -1;
+		hi = lo;
+		step = 1;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+			if (end == p)
+				return -1;
+			if (*end == ':') {
+				p = end + 1;
+				step = strtol(p, &end, 10);
+				if (end == p || step <= 0)
+					return -1;
+			}
+		}
+		if (lo < ax->min || hi > ax->max || lo > hi)
+			return -1;
+		for (; lo <= hi; lo += step) {
+			if (ax->nvals == SWEEP_MAX_VALUES)
+				return -1;
+			ax->vals[ax->nvals++] = lo;
+		}
+		p = end;
+	} while (*p == ',');
+
+	return *p == '\0' ? 0 : -1;
+}
+
+/*
+ * Count the cells and start every swept setting at its first value, so
+ * the usual validation sees a real configuration. Returns -1 if there
+ * are too many cells.
+ */
+static int
+sweep_init(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_SWEEP; i++) {
+		if (sweep_axes[i].nvals == 0)
+			continue;
+		nsweep_cells = (nsweep_cells != 0 ? nsweep_cells : 1) *
+		    sweep_axes[i].nvals;
+		if (nsweep_cells > SWEEP_MAX_CELLS)
+			return -1;
+		*sweep_axes[i].var = sweep_axes[i].vals[0];
+	}
+
+	return 0;
+}
+
+/* Set the swept settings for a cell, the last axis changing fastest. */
+static void
+sweep_set(int cell)
+{
+	int i;
+
+	for (i = NUM_SWEEP - 1; i >= 0; i--) {
+		if (sweep_axes[i].nvals == 0)
+			continue;
+		*sweep_axes[i].var = sweep_axes[i].vals[cell %
+		    sweep_axes[i].nvals];
+		cell /= sweep_axes[i].nvals;
+	}
+}
+
+/* Print each swept setting of the current cell with fmt(name, value). */
+static void
+sweep_print_settings(FILE *f, const char *fmt)
+{
+	int i;
+
+	for (i = 0; i < NUM_SWEEP; i++)
+		if (sweep_axes[i].nvals != 0)
+			fprintf(f, fmt, sweep_axes[i].name, *sweep_axes[i].var);
+}
+
+static void
+sweep_print(int cell, const struct sweep_result *r)
+{
+
+	printf("W> Cell: %d/%d", cell + 1, nsweep_cells);
+	sweep_print_settings(stdout, ", %s: %d");
+	if (!r->done) {
+		printf(", failed\n");
+		fflush(stdout);
+		return;
+	}
+	printf(", Ticks: %" PRIu64 ", "
+	    "p50: %.3f, p90: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Late p50: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Dropped: %" PRIu64 ", Lost: %" PRIu64 "\n",
+	    r->ticks, NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]),
+	    NS_TO_US(r->pv[2]), NS_TO_US(r->pv[3]), NS_TO_US(r->pv[4]),
+	    NS_TO_US(r->max), NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]),
+	    NS_TO_US(r->lv[3]), NS_TO_US(r->lv[4]), NS_TO_US(r->late_max),
+	    r->dropped, r->lost);
+	fflush(stdout);
+}
+
+static FILE *
+sweep_open(const char *suffix)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s.sweep.%s", csv_prefix, suffix);
+	f = fopen(path, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Failed to open: %s\n", path);
+		exit(1);
+	}
+
+	return f;
+}
+
+static void
+sweep_write_csv(const struct sweep_result *results)
+{
+	const struct sweep_result *r;
+	FILE *f;
+	int cell, i;
+
+	f = sweep_open("csv");
+	fprintf(f, "Cell");
+	for (i = 0; i < NUM_SWEEP; i++)
+		if (sweep_axes[i].nvals != 0)
+			fprintf(f, ",%s", sweep_axes[i].name);
+	fprintf(f, ",Ticks,P50,P90,P99,P99.9,P99.99,Max,"
+	    "Late_P50,Late_P99,Late_P99.9,Late_P99.99,Late_Max,"
+	    "Dropped,Lost\n");
+
+	for (cell = 0; cell < nsweep_cells; cell++) {
+		r = &results[cell];
+		if (!r->done)
+			continue;
+		sweep_set(cell);
+		fprintf(f, "%d", cell + 1);
+		sweep_print_settings(f, ",%.0s%d");
+		fprintf(f, ",%" PRIu64 ",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+		    "%.3f,%.3f,%.3f,%.3f,%.3f,%" PRIu64 ",%" PRIu64 "\n",
+		    r->ticks, NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]),
+		    NS_TO_US(r->pv[2]), NS_TO_US(r->pv[3]),
+		    NS_TO_US(r->pv[4]), NS_TO_US(r->max),
+		    NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]),
+		    NS_TO_US(r->lv[3]), NS_TO_US(r->lv[4]),
+		    NS_TO_US(r->late_max), r->dropped, r->lost);
+	}
+	fclose(f);
+}
+
+static void
+sweep_write_json(const struct sweep_result *results)
+{
+	const struct sweep_result *r;
+	const char *sep;
+	FILE *f;
+	int cell, i;
+
+	f = sweep_open("json");
+	fprintf(f, "{\n  \"sweep_time\": %d,\n  \"axes\": {", sweep_time);
+	sep = "";
+	for (i = 0; i < NUM_SWEEP; i++) {
+		if (sweep_axes[i].nvals == 0)
+			continue;
+		fprintf(f, "%s\n    \"%s\": [", sep, sweep_axes[i].name);
+		for (cell = 0; cell < sweep_axes[i].nvals; cell++)
+			fprintf(f, "%s%d", cell ? ", " : "",
+			    sweep_axes[i].vals[cell]);
+		fprintf(f, "]");
+		sep = ",";
+	}
+	fprintf(f, "\n  },\n  \"cells\": [");
+
+	sep = "";
+	for (cell = 0; cell < nsweep_cells; cell++) {
+		r = &results[cell];
+		if (!r->done)
+			continue;
+		sweep_set(cell);
+		fprintf(f, "%s\n    { \"cell\": %d", sep, cell + 1);
+		sweep_print_settings(f, ", \"%s\": %d");
+		fprintf(f, ", \"ticks\": %" PRIu64 ", "
+		    "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+		    "\"p99.9\": %.3f, \"p99.99\": %.3f, \"max\": %.3f, "
+		    "\"late_p50\": %.3f, \"late_p99\": %.3f, "
+		    "\"late_p99.9\": %.3f, \"late_p99.99\": %.3f, "
+		    "\"late_max\": %.3f, \"dropped\": %" PRIu64 ", "
+		    "\"lost\": %" PRIu64 " }",
+		    r->ticks, NS_TO_US(r->pv[0]), NS_TO_US(r->pv[1]),
+		    NS_TO_US(r->pv[2]), NS_TO_US(r->pv[3]),
+		    NS_TO_US(r->pv[4]), NS_TO_US(r->max),
+		    NS_TO_US(r->lv[0]), NS_TO_US(r->lv[2]),
+		    NS_TO_US(r->lv[3]), NS_TO_US(r->lv[4]),
+		    NS_TO_US(r->late_max), r->dropped, r->lost);
+		sep = ",";
+	}
+	fprintf(f, "\n  ]\n}\n");
+	fclose(f);
+}
+
+/*
+ * The timer and I/O CSVs --csv opened belong to the cells. The
+ * orchestrator removes its own (create is 0) and every cell opens
+ * file.<cell>.timer.csv and file.<cell>.io.csv in their place.
+ */
+static void
+sweep_csv_swap(int *fd, const char *name, int create)
+{
+	char path[PATH_MAX];
+
+	close(*fd);
+	snprintf(path, sizeof(path), "%s.%s.csv", csv_prefix, name);
+	if (!create) {
+		unlink(path);
+		*fd = -1;
+		return;
+	}
+
+	*fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR);
+	if (*fd == -1) {
+		fprintf(stderr, "Failed to open: %s\n", path);
+		exit(1);
+	}
+}
+
+/*
+ * Run the cells one after the other. Returns only in a cell's child,
+ * with that cell's settings in place and csv_prefix pointing at its own
+ * files; the orchestrator exits when the sweep is done or interrupted.
+ */
+static void
+sweep_run(void)
+{
+	struct sweep_result *results;
+	char *prefix;
+	pid_t pid;
+	int cell, status, ms;
+
+	results = mmap(NULL, nsweep_cells * sizeof(*results),
+	    PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED) {
+		fprintf(stderr, "Failed to map sweep results\n");
+		exit(1);
+	}
+
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	if (csv_prefix != NULL) {
+		sweep_csv_swap(&tcsv_fd, "timer", 0);
+		sweep_csv_swap(&icsv_fd, "io", 0);
+	}
+
+	printf("Sweep: %d cells of %d s\n", nsweep_cells, sweep_time);
+	fflush(stdout);
+
+	for (cell = 0; cell < nsweep_cells && !stop_requested; cell++) {
+		sweep_set(cell);
+		printf("W> Cell: %d/%d", cell + 1, nsweep_cells);
+		sweep_print_settings(stdout, ", %s: %d");
+		printf(", starting\n");
+		fflush(stdout);
+
+		pid = fork();
+		if (pid == -1) {
+			perror("fork");
+			exit(1);
+		} else if (pid == 0) {
+			/* Each cell is stopped as a group, like a run from a tty. */
+			setpgid(0, 0);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			sweep_cell = &results[cell];
+			if (csv_prefix != NULL) {
+				if (asprintf(&prefix, "%s.%d", csv_prefix,
+				    cell + 1) == -1) {
+					fprintf(stderr, "Failed to allocate "
+					    "memory\n");
+					exit(1);
+				}
+				csv_prefix = prefix;
+				sweep_csv_swap(&tcsv_fd, "timer", 1);
+				sweep_csv_swap(&icsv_fd, "io", 1);
+			}
+			return;
+		}
+
+		/*
+		 * A cell runs for sweep_time s unless it converges first.
+		 * SIGINT/SIGTERM end it early, and the sweep with it. The
+		 * group kill also gets I/O procs a threads cell leaves.
+		 */
+		setpgid(pid, pid);
+		for (ms = 0; ms < sweep_time * 1000 && !stop_requested;
+		    ms += 100) {
+			if (waitpid(pid, &status, WNOHANG) == pid)
+				break;
+			usleep(100000);
+		}
+		kill(-pid, SIGINT);
+		waitpid(pid, &status, 0);
+
+		sweep_print(cell, &results[cell]);
+	}
+
+	if (csv_prefix != NULL) {
+		sweep_write_csv(results);
+		sweep_write_json(results);
+	}
+
+	exit(0);
+}
+
+/*
+ * The --aggregate collector. Runs in the parent (or main thread with
+ * --threads) and is the only reader of the arena.
+ */
+static struct {
+	uint64_t	interval;	/* ns between consolidated lines */
+	struct hist	*prev_gap;	/* Last snapshot, per slot. */
+	struct hist	*prev_late;
+	struct hist	*gap, *late;	/* Merged interval deltas. */
+	struct hist	*snap;
+	uint64_t	dropped, lost;	/* Whole run. */
+	struct report	*last;		/* Latest report, per slot. */
+} coll;
+
+static void
+collector_init(void)
+{
+
+	coll.interval = (uint64_t)iters * timerfreq * 1000;
+	coll.prev_gap = calloc(arena->nslots, sizeof(struct hist));
+	coll.prev_late = calloc(arena->nslots, sizeof(struct hist));
+	coll.gap = malloc(sizeof(struct hist));
+	coll.late = malloc(sizeof(struct hist));
+	coll.snap = malloc(sizeof(struct hist));
+	coll.last = calloc(arena->nslots, sizeof(struct report));
+	if (coll.prev_gap == NULL || coll.prev_late == NULL ||
+	    coll.gap == NULL || coll.late == NULL || coll.snap == NULL ||
+	    coll.last == NULL) {
+		fprintf(stderr, "Failed to allocate collector state\n");
+		exit(1);
+	}
+}
+
+/*
+ * --converge: stop once the target percentile is known well enough.
+ * Every collector interval is one batch; the run ends when the 95%
+ * confidence half-width of the mean of the batch percentiles drops
+ * under --converge-err percent of that mean (batch means), or after
+ * --converge-max seconds.
+ */
+#define CONVERGE_MIN_BATCHES	10
+#define DFLT_CONVERGE_ERR	5
+#define DFLT_CONVERGE_MAX	600
+
+/* Student's t at 97.5% for 1..30 degrees of freedom, then normal. */
+static const double t_975[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+	2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+	2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+	2.048, 2.045, 2.042,
+};
+#define NUM_T_975	(sizeof(t_975) / sizeof(t_975[0]))
+
+static struct {
+	double		pct;		/* Target percentile, 0 if off. */
+	double		err;		/* Relative half-width, percent. */
+	int		max_secs;
+	int		batches;
+	double		sum, sumsq;	/* Of the batch percentiles, ns. */
+	double		mean, half;	/* Latest estimate. */
+	int		converged;
+} conv = { 0, DFLT_CONVERGE_ERR, DFLT_CONVERGE_MAX, 0, 0, 0, 0, 0, 0 };
+
+/*
+ * Add one batch, print a C> line and request a stop when the estimate
+ * is good enough or time is up.
+ */
+static void
+converge_batch(const struct hist *h, uint64_t now)
+{
+	uint64_t v;
+	double var;
+
+	hist_percentiles(h, &conv.pct, 1, &v);
+	conv.batches++;
+	conv.sum += v;
+	conv.sumsq += (double)v * v;
+	conv.mean = conv.sum / conv.batches;
+	conv.half = 0;
+	if (conv.batches > 1) {
+		var = (conv.sumsq - conv.sum * conv.mean) /
+		    (conv.batches - 1);
+		conv.half = sqrt(var > 0 ? var : 0) / sqrt(conv.batches) *
+		    (conv.batches - 1 <= (int)NUM_T_975 ?
+		    t_975[conv.batches - 2] : 1.96);
+	}
+
+	if (conv.batches >= CONVERGE_MIN_BATCHES &&
+	    conv.half <= conv.mean * conv.err / 100)
+		conv.converged = 1;
+
+	printf("C> Batches: %d, p%g: %.3f +/- %.3f (%.1f%%)%s\n",
+	    conv.batches, conv.pct, NS_TO_US(conv.mean), NS_TO_US(conv.half),
+	    conv.mean > 0 ? conv.half * 100 / conv.mean : 0.0,
+	    conv.converged ? ", converged" : "");
+	fflush(stdout);
+
+	if (conv.converged ||
+	    now - prog_start >= (uint64_t)conv.max_secs * 1000000000)
+		stop_requested = 1;
+}
+
+/* Merge what src gained since prev into dst, then make prev current. */
+static void
+collect_hist_delta(struct hist *dst, const struct hist *src,
+    struct hist *prev)
+{
+
+	memcpy(coll.snap, src, sizeof(*coll.snap));
+	hist_merge_delta(dst, coll.snap, prev);
+	memcpy(prev, coll.snap, sizeof(*prev));
+}
+
+/*
+ * Drain every slot's ring, printing the per-proc lines, then print one
+ * consolidated A> line for all timers built from the histogram deltas
+ * since the last call.
+ */
+static void
+collect_interval(uint64_t now)
+{
+	struct arena_slot *slot;
+	struct report rep;
+	uint64_t pv[NUM_REPORT_PCTS], lv[NUM_REPORT_PCTS];
+	uint64_t dropped, lost, worst_late;
+	int i, nreports, ntimers, worst;
+
+	hist_reset(coll.gap);
+	hist_reset(coll.late);
+	dropped = lost = worst_late = 0;
+	nreports = ntimers = 0;
+	worst = -1;
+
+	for (i = 0; i < arena->nslots; i++) {
+		slot = &arena->slots[i];
+
+		while (report_ring_pop(&slot->ring, &rep)) {
+			if (rep.kind == slot->kind)
+				coll.last[i] = rep;
+			if (rep.kind == SLOT_IO) {
+				io_report_print(&rep.io);
+				continue;
+			}
+			if (rep.kind == SLOT_MEM) {
+				mem_report_print(&rep.mem);
+				continue;
+			}
+			if (rep.kind == SLOT_SPIKE) {
+				spike_print(&rep.spike);
+				continue;
+			}
+			if (rep.kind == SLOT_CLASS) {
+				class_report_print(&rep.klass);
+				continue;
+			}
+			if (rep.kind == SLOT_NET) {
+				net_report_print(&rep.net);
+				continue;
+			}
+
+			timer_report_print(&rep.timer);
+			nreports++;
+			dropped += rep.timer.dropped;
+			lost += rep.timer.lost;
+			if (worst == -1 || rep.timer.lv[3] > worst_late) {
+				worst = rep.timer.index;
+				worst_late = rep.timer.lv[3];
+			}
+		}
+
+		if (slot->kind != SLOT_TIMER)
+			continue;
+
+		ntimers++;
+		collect_hist_delta(coll.gap, &slot->run_hist,
+		    &coll.prev_gap[i]);
+		collect_hist_delta(coll.late, &slot->run_late_hist,
+		    &coll.prev_late[i]);
+	}
+
+	coll.dropped += dropped;
+	coll.lost += lost;
+
+	if (coll.gap->total == 0)
+		return;
+
+	hist_percentiles(coll.gap, report_pcts, NUM_REPORT_PCTS, pv);
+	hist_percentiles(coll.late, report_pcts, NUM_REPORT_PCTS, lv);
+
+	printf("A> t: %ld, Timers: %d, Reports: %d, Ticks: %ld, "
+	    "p50: %.3f, p90: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Late p50: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Dropped: %ld, Lost: %ld, Worst: #%d (Late p99.9: %.3f)\n",
+	    (now - prog_start) / 1000000000, ntimers, nreports,
+	    coll.gap->total, NS_TO_US(pv[0]), NS_TO_US(pv[1]),
+	    NS_TO_US(pv[2]), NS_TO_US(pv[3]), NS_TO_US(pv[4]),
+	    NS_TO_US(coll.gap->max), NS_TO_US(lv[0]), NS_TO_US(lv[2]),
+	    NS_TO_US(lv[3]), NS_TO_US(lv[4]), NS_TO_US(coll.late->max),
+	    dropped, lost, worst, NS_TO_US(worst_late));
+	fflush(stdout);
+
+	if (acsv_fd != -1)
+		write_fd(acsv_fd,
+		    "%ld,%d,%d,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+		    "%.3f,%.3f,%.3f,%.3f,%.3f,%ld,%ld,%d\n",
+		    (now - prog_start) / 1000000000, ntimers, nreports,
+		    coll.gap->total, NS_TO_US(pv[0]), NS_TO_US(pv[1]),
+		    NS_TO_US(pv[2]), NS_TO_US(pv[3]), NS_TO_US(pv[4]),
+		    NS_TO_US(coll.gap->max), NS_TO_US(lv[0]), NS_TO_US(lv[2]),
+		    NS_TO_US(lv[3]), NS_TO_US(lv[4]), NS_TO_US(coll.late->max),
+		    dropped, lost, worst);
+
+	if (cgroup_root != NULL)
+		cgroup_report(now);
+
+	/* The flush after a stop is not a whole batch. */
+	if (conv.pct != 0 && !stop_requested)
+		converge_batch(coll.gap, now);
+}
+
+/* Whole-run percentiles over every timer, printed once at the end. */
+static void
+collect_totals(void)
+{
+	uint64_t pv[NUM_REPORT_PCTS], lv[NUM_REPORT_PCTS];
+	int i;
+
+	hist_reset(coll.gap);
+	hist_reset(coll.late);
+	for (i = 0; i < arena->nslots; i++) {
+		if (arena->slots[i].kind != SLOT_TIMER)
+			continue;
+		hist_merge(coll.gap, &arena->slots[i].run_hist);
+		hist_merge(coll.late, &arena->slots[i].run_late_hist);
+	}
+
+	hist_percentiles(coll.gap, report_pcts, NUM_REPORT_PCTS, pv);
+	hist_percentiles(coll.late, report_pcts, NUM_REPORT_PCTS, lv);
+
+	printf("A> Total: Ticks: %ld, "
+	    "p50: %.3f, p90: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f, "
+	    "Late p50: %.3f, p99: %.3f, p99.9: %.3f, p99.99: %.3f, Max: %.3f\n",
+	    coll.gap->total, NS_TO_US(pv[0]), NS_TO_US(pv[1]),
+	    NS_TO_US(pv[2]), NS_TO_US(pv[3]), NS_TO_US(pv[4]),
+	    NS_TO_US(coll.gap->max), NS_TO_US(lv[0]), NS_TO_US(lv[2]),
+	    NS_TO_US(lv[3]), NS_TO_US(lv[4]), NS_TO_US(coll.late->max));
+	if (conv.pct != 0)
+		printf("C> %s after %d batches: p%g: %.3f +/- %.3f\n",
+		    conv.converged ? "Converged" : "Not converged",
+		    conv.batches, conv.pct, NS_TO_US(conv.mean),
+		    NS_TO_US(conv.half));
+	fflush(stdout);
+
+	if (sweep_cell != NULL) {
+		sweep_cell->ticks = coll.gap->total;
+		sweep_cell->dropped = coll.dropped;
+		sweep_cell->lost = coll.lost;
+		memcpy(sweep_cell->pv, pv, sizeof(pv));
+		memcpy(sweep_cell->lv, lv, sizeof(lv));
+		sweep_cell->max = coll.gap->max;
+		sweep_cell->late_max = coll.late->max;
+		sweep_cell->done = 1;
+	}
+}
+
+/*
+ * --stats-socket: every connection to the Unix socket gets one JSON
+ * snapshot of the run so far and is closed. It is served from the
+ * collector, which only reads the arena, so a scraper never touches the
+ * timers. Sends never block; a client too slow to take the snapshot in
+ * one go just loses it.
+ */
+static const char *stats_path;
+static int stats_fd = -1;
+
+static void
+stats_listen(void)
+{
+	struct sockaddr_un sun;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", stats_path);
+	unlink(stats_path);
+
+	stats_fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (stats_fd == -1 ||
+	    bind(stats_fd, (struct sockaddr *)&sun, sizeof(sun)) != 0 ||
+	    listen(stats_fd, 16) != 0) {
+		fprintf(stderr, "Failed to listen on %s: %s\n", stats_path,
+		    strerror(errno));
+		exit(1);
+	}
+}
+
+static void
+stats_close(void)
+{
+
+	if (stats_fd == -1)
+		return;
+	close(stats_fd);
+	unlink(stats_path);
+	stats_fd = -1;
+}
+
+/* Percentiles, max and the non-empty buckets as [lo, hi, count]. */
+static void
+stats_hist(FILE *f, const char *name, const struct hist *h)
+{
+	uint64_t v[NUM_REPORT_PCTS];
+	const char *sep;
+	unsigned i;
+
+	hist_percentiles(h, report_pcts, NUM_REPORT_PCTS, v);
+	fprintf(f, "\"%s\": { \"count\": %" PRIu64, name, h->total);
+	for (i = 0; i < NUM_REPORT_PCTS; i++)
+		fprintf(f, ", \"p%g\": %.3f", report_pcts[i],
+		    NS_TO_US(v[i]));
+	fprintf(f, ", \"max\": %.3f, \"buckets\": [", NS_TO_US(h->max));
+	sep = "";
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (h->counts[i] == 0)
+			continue;
+		fprintf(f, "%s[%.3f, %.3f, %" PRIu64 "]", sep,
+		    NS_TO_US(hist_bucket_lo(i)), NS_TO_US(hist_bucket_hi(i)),
+		    h->counts[i]);
+		sep = ", ";
+	}
+	fprintf(f, "] }");
+}
+
+static void
+stats_proc(FILE *f, const struct arena_slot *slot, const struct report *r)
+{
+	static const char *kinds[] = {
+		[SLOT_TIMER] = "timer", [SLOT_IO] = "io", [SLOT_MEM] = "mem",
+		[SLOT_NET] = "net",
+	};
+
+	fprintf(f, "{ \"kind\": \"%s\", \"index\": %d, \"pid\": %d, "
+	    "\"alive\": %s", kinds[slot->kind], slot->index, (int)slot->pid,
+	    slot->pid > 0 && kill(slot->pid, 0) == 0 ? "true" : "false");
+
+	if (slot->kind == SLOT_TIMER) {
+		fprintf(f, ", \"ticks\": %" PRIu64 ", \"max\": %.3f, "
+		    "\"late_max\": %.3f", slot->run_hist.total,
+		    NS_TO_US(slot->run_hist.max),
+		    NS_TO_US(slot->run_late_hist.max));
+		if (r->timer.t != 0)
+			fprintf(f, ", \"last\": { \"t\": %.3f, \"cpu\": %d, "
+			    "\"count\": %" PRIu64 ", \"min\": %.3f, "
+			    "\"max\": %.3f, \"avg\": %.3f, \"p99\": %.3f, "
+			    "\"late_p99.9\": %.3f, \"dropped\": %" PRIu64 ", "
+			    "\"lost\": %" PRIu64 " }",
+			    (double)(r->timer.t - prog_start) / 1e9,
+			    r->timer.cpu, r->timer.count,
+			    NS_TO_US(r->timer.min), NS_TO_US(r->timer.max),
+			    r->timer.avg, NS_TO_US(r->timer.pv[2]),
+			    NS_TO_US(r->timer.lv[3]), r->timer.dropped,
+			    r->timer.lost);
+	} else if (slot->kind == SLOT_IO && r->io.t != 0)
+		fprintf(f, ", \"last\": { \"t\": %.3f, \"mb_s\": %.1f, "
+		    "\"iops\": %.0f, \"lat_p99\": %.3f, \"lat_max\": %.3f }",
+		    (double)(r->io.t - prog_start) / 1e9,
+		    r->io.bytes / r->io.us, r->io.ops * 1e6 / r->io.us,
+		    NS_TO_US(r->io.lat_p99), NS_TO_US(r->io.lat_max));
+	else if (slot->kind == SLOT_MEM && r->mem.t != 0)
+		fprintf(f, ", \"last\": { \"t\": %.3f, \"mb_s\": %.1f, "
+		    "\"faults_s\": %.0f, \"alloc_p99\": %.3f }",
+		    (double)(r->mem.t - prog_start) / 1e9,
+		    r->mem.bytes / r->mem.us,
+		    (r->mem.minflt + r->mem.majflt) * 1e6 / r->mem.us,
+		    NS_TO_US(r->mem.lat_p99));
+	else if (slot->kind == SLOT_NET && r->net.t != 0)
+		fprintf(f, ", \"last\": { \"t\": %.3f, \"pps\": %.0f, "
+		    "\"gbps\": %.3f, \"lat_p99\": %.3f, \"lat_max\": %.3f }",
+		    (double)(r->net.t - prog_start) / 1e9,
+		    r->net.msgs * 1e6 / r->net.us,
+		    r->net.bytes * 8 / r->net.us / 1000.0,
+		    NS_TO_US(r->net.lat_p99), NS_TO_US(r->net.lat_max));
+	fprintf(f, " }");
+}
+
+/* Answer every pending connection with a snapshot. */
+static void
+stats_serve(uint64_t now)
+{
+	char *buf;
+	size_t len;
+	FILE *f;
+	int i, fd;
+
+	while ((fd = accept4(stats_fd, NULL, NULL,
+	    SOCK_NONBLOCK|SOCK_CLOEXEC)) != -1) {
+		hist_reset(coll.gap);
+		hist_reset(coll.late);
+		for (i = 0; i < arena->nslots; i++) {
+			if (arena->slots[i].kind != SLOT_TIMER)
+				continue;
+			hist_merge(coll.gap, &arena->slots[i].run_hist);
+			hist_merge(coll.late, &arena->slots[i].run_late_hist);
+		}
+
+		f = open_memstream(&buf, &len);
+		if (f == NULL) {
+			close(fd);
+			continue;
+		}
+		fprintf(f, "{ \"t\": %.3f, \"dropped\": %" PRIu64 ", "
+		    "\"lost\": %" PRIu64 ", ",
+		    (double)(now - prog_start) / 1e9, coll.dropped, coll.lost);
+		stats_hist(f, "gap", coll.gap);
+		fprintf(f, ", ");
+		stats_hist(f, "late", coll.late);
+		if (conv.pct != 0)
+			fprintf(f, ", \"converge\": { \"pct\": %g, "
+			    "\"batches\": %d, \"mean\": %.3f, \"half\": %.3f, "
+			    "\"converged\": %s }", conv.pct, conv.batches,
+			    NS_TO_US(conv.mean), NS_TO_US(conv.half),
+			    conv.converged ? "true" : "false");
+		fprintf(f, ", \"procs\": [");
+		for (i = 0; i < arena->nslots; i++) {
+			fprintf(f, "%s\n  ", i != 0 ? "," : "");
+			stats_proc(f, &arena->slots[i], &coll.last[i]);
+		}
+		fprintf(f, "\n] }\n");
+		fclose(f);
+
+		send(fd, buf, len, MSG_DONTWAIT|MSG_NOSIGNAL);
+		free(buf);
+		close(fd);
+	}
+}
+
+/*
+ * Print a consolidated line every interval until a stop is requested.
+ * wait_mask is the signal mask to wait with, as for sigsuspend().
+ */
+static void
+collector_loop(const sigset_t *wait_mask)
+{
+	struct pollfd pfd;
+	struct timespec ts;
+	uint64_t now, next;
+
+	if (stats_path != NULL)
+		stats_listen();
+	pfd.fd = stats_fd;
+	pfd.events = POLLIN;
+	next = get_time() + coll.interval;
+	while (!stop_requested) {
+		now = get_time();
+		if (now < next) {
+			ns_to_timespec(next - now, &ts);
+			if (ppoll(&pfd, stats_fd != -1, &ts, wait_mask) > 0)
+				stats_serve(get_time());
+			continue;
+		}
+
+		collect_interval(now);
+		next += coll.interval;
+	}
+}
+
+/*
+ * The parent's job with --aggregate when timers are processes: collect
+ * until SIGINT/SIGTERM, then stop every child and print the totals.
+ */
+static int
+run_collector(void)
+{
+	sigset_t mask;
+	int i;
+
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	collector_init();
+	sigprocmask(SIG_SETMASK, NULL, &mask);
+	collector_loop(&mask);
+
+	for (i = 0; i < arena->nslots; i++)
+		if (arena->slots[i].pid > 0)
+			kill(arena->slots[i].pid, SIGTERM);
+	/* With --launch-fanout not all of them are our own children. */
+	while (waitpid(-1, NULL, 0) != -1 || errno == EINTR)
+		;
+
+	collect_interval(get_time());
+	collect_totals();
+	stats_close();
+
+	return 0;
+}
+
+/*
+ * Parse a comma separated list of tick backend names into backends[].
+ * Returns the number of entries, or -1 on error.
+ */
+static int
+parse_backend_list(const char *list)
+{
+	const char *p, *end;
+	size_t len;
+	int n, b;
+
+	n = 0;
+	for (p = list; *p != '\0'; p = *end == ',' ? end + 1 : end) {
+		end = strchrnul(p, ',');
+		len = end - p;
+
+		for (b = 0; b < NUM_TICK; b++)
+			if (strlen(tick_backends[b].name) == len &&
+			    strncmp(p, tick_backends[b].name, len) == 0)
+				break;
+		if (b == NUM_TICK || n == NUM_TICK)
+			return -1;
+		backends[n++] = b;
+	}
+
+	return n;
+}
+
+/*
+ * --threads: one thread per timer, all in this process. Returns once
+ * SIGINT/SIGTERM has been seen and every thread has stopped.
+ */
+static int
+run_timer_threads(int nthreads, const int *cpus, int ncpus)
+{
+	struct timer_state **states;
+	pthread_t *threads;
+	sigset_t mask, omask;
+	int i, ret;
+
+	states = calloc(nthreads, sizeof(*states));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (states == NULL || threads == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		return 1;
+	}
+
+	/* Stop signals are for the main thread only. */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, &omask);
+
+	for (i = 0; i < nthreads; i++) {
+		states[i] = timer_state_alloc(i);
+		if (ncpus > 0)
+			states[i]->cpu = cpus[i % ncpus];
+		states[i]->backend = backends[i % nbackends];
+		if (arena != NULL) {
+			states[i]->slot = &arena->slots[i];
+			states[i]->slot->pid = getpid();
+		}
+
+		ret = pthread_create(&threads[i], NULL, timer_thread,
+		    states[i]);
+		if (ret != 0) {
+			fprintf(stderr, "pthread_create: %s\n",
+			    strerror(ret));
+			return 1;
+		}
+	}
+
+	if (arena != NULL) {
+		collector_init();
+		collector_loop(&omask);
+	} else
+		while (!stop_requested)
+			sigsuspend(&omask);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	if (arena != NULL) {
+		collect_interval(get_time());
+		collect_totals();
+		stats_close();
+	}
+
+	print_jitter_table(states, nthreads, TABLE_BY_CPU);
+	if (nbackends > 1)
+		print_jitter_table(states, nthreads, TABLE_BY_BACKEND);
+	for (i = 0; i < nthreads; i++)
+		timer_dump_hists(states[i]);
+
+	return 0;
+}
+
+/*
+ * I/O load engines for the io procs, selected with --io-engine. Each
+ * proc owns one unlinked file of io_count blocks in --io-dir. A pass
+ * issues io_count block sized reads or writes against it, sequential
+ * or random, with --io-rwmix percent of them reads. Buffers are filled
+ * once with random bytes and page aligned, so the load is storage
+ * rather than a copy from /dev/zero.
+ */
+enum {
+	IO_BUFFERED,
+	IO_DIRECT,
+	IO_PWRITEV,
+	IO_URING,
+	NUM_IO_ENGINE,
+};
+
+enum { IO_SEQ, IO_RAND };
+
+struct io_uring_ctx {
+	int			fd;
+	unsigned		*sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned		*cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe	*sqes;
+	struct io_uring_cqe	*cqes;
+	int			*free_bufs;	/* Buffers not in flight. */
+};
+
+struct io_ctx {
+	int		engine;		/* IO_* */
+	int		fd;
+	int		direct;		/* File opened O_DIRECT. */
+	int		bs;
+	int		count;		/* Ops per pass. */
+	int		depth;		/* Ops in flight or per vector. */
+	int		pattern;	/* IO_SEQ or IO_RAND. */
+	int		rwmix;		/* Percentage of reads. */
+	uint64_t	next;		/* Next block for IO_SEQ. */
+	char		**bufs;		/* depth buffers of bs bytes. */
+	uint64_t	*issued;	/* Per buffer, when its op went out. */
+	struct iovec	*iov;
+	struct hist	lat;		/* Per op latency of this pass. */
+	struct io_uring_ctx uring;
+};
+
+struct io_engine {
+	const char	*name;
+	void		(*init)(struct io_ctx *);
+	void		(*pass)(struct io_ctx *);
+};
+
+static const struct io_engine io_engines[NUM_IO_ENGINE];
+
+/* Pick the next block offset and whether it is read or written. */
+static inline off_t
+io_next(struct io_ctx *io, int *is_read)
+{
+	uint64_t blk;
+
+	if (io->pattern == IO_RAND)
+		blk = (uint64_t)random() % io->count;
+	else
+		blk = io->next++ % io->count;
+
+	*is_read = io->rwmix > 0 && random() % 100 < io->rwmix;
+
+	return (off_t)blk * io->bs;
+}
+
+static void
+io_fail(const char *what, ssize_t ret, size_t want)
+{
+
+	fprintf(stderr, "I/O %s returned %zd of %zu bytes: %s\n", what, ret,
+	    want, ret < 0 ? strerror(errno) : "short transfer");
+	exit(1);
+}
+
+static void
+io_sync_pass(struct io_ctx *io)
+{
+	ssize_t ret;
+	off_t off;
+	int i, rd;
+	uint64_t start;
+
+	for (i = 0; i < io->count; i++) {
+		off = io_next(io, &rd);
+		start = get_time();
+		if (rd)
+			ret = preadn(io->fd, io->bufs[0], io->bs, off);
+		else
+			ret = pwriten(io->fd, io->bufs[0], io->bs, off);
+		if (ret != io->bs)
+			io_fail(rd ? "read" : "write", ret, io->bs);
+		hist_record(&io->lat, get_time() - start);
+	}
+}
+
+/*
+ * Vectored: each call moves depth adjacent blocks from depth separate
+ * buffers, so a pass takes count / depth syscalls.
+ */
+static void
+io_vec_pass(struct io_ctx *io)
+{
+	uint64_t start;
+	ssize_t ret;
+	size_t want;
+	off_t off;
+	int i, n, rd;
+
+	for (i = 0; i < io->count; i += n) {
+		off = io_next(io, &rd);
+		n = io->depth;
+		if (n > io->count - i)
+			n = io->count - i;
+		if (n > io->count - off / io->bs)
+			n = io->count - off / io->bs;
+		if (io->pattern == IO_SEQ)
+			io->next += n - 1;
+
+		want = (size_t)n * io->bs;
+		start = get_time();
+		if (rd)
+			ret = preadv(io->fd, io->iov, n, off);
+		else
+			ret = pwritev(io->fd, io->iov, n, off);
+		if (ret < 0 || (size_t)ret != want)
+			io_fail(rd ? "preadv" : "pwritev", ret, want);
+		hist_record(&io->lat, get_time() - start);
+	}
+}
+
+static void
+io_vec_init(struct io_ctx *io)
+{
+	int i;
+
+	io->iov = calloc(io->depth, sizeof(*io->iov));
+	if (io->iov == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < io->depth; i++) {
+		io->iov[i].iov_base = io->bufs[i];
+		io->iov[i].iov_len = io->bs;
+	}
+}
+
+/*
+ * io_uring through the raw syscalls, so no liburing is needed. Keeps
+ * up to depth ops in flight, one buffer each.
+ */
+static void
+io_uring_init(struct io_ctx *io)
+{
+	struct io_uring_ctx *u = &io->uring;
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, io->depth, &p);
+	if (u->fd == -1) {
+		fprintf(stderr, "io_uring_setup failed: %s\n",
+		    strerror(errno));
+		exit(1);
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size)
+			sq_size = cq_size;
+		cq_size = sq_size;
+	}
+
+	sq = mmap(NULL, sq_size, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else {
+		cq = mmap(NULL, cq_size, PROT_READ|PROT_WRITE,
+		    MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+
+	u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	    PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd,
+	    IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	u->free_bufs = calloc(io->depth, sizeof(*u->free_bufs));
+	if (u->free_bufs == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+}
+
+static void
+io_uring_pass(struct io_ctx *io)
+{
+	struct io_uring_ctx *u = &io->uring;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	uint64_t now;
+	unsigned tail, head, idx;
+	int *free_bufs, nfree, submitted, done, to_submit, rd, ret;
+
+	free_bufs = u->free_bufs;
+	for (nfree = 0; nfree < io->depth; nfree++)
+		free_bufs[nfree] = nfree;
+
+	submitted = done = 0;
+	while (done < io->count) {
+		to_submit = 0;
+		tail = *u->sq_tail;
+		while (nfree > 0 && submitted + to_submit < io->count) {
+			idx = tail & *u->sq_mask;
+			sqe = &u->sqes[idx];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->off = io_next(io, &rd);
+			sqe->opcode = rd ? IORING_OP_READ : IORING_OP_WRITE;
+			sqe->fd = io->fd;
+			sqe->user_data = free_bufs[--nfree];
+			sqe->addr = (uintptr_t)io->bufs[sqe->user_data];
+			sqe->len = io->bs;
+			io->issued[sqe->user_data] = get_time();
+			u->sq_array[idx] = idx;
+			tail++;
+			to_submit++;
+		}
+		__atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+
+		ret = syscall(__NR_io_uring_enter, u->fd, to_submit, 1,
+		    IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				ret = 0;
+			else {
+				fprintf(stderr, "io_uring_enter failed: %s\n",
+				    strerror(errno));
+				exit(1);
+			}
+		}
+		submitted += to_submit;
+
+		now = get_time();
+		head = *u->cq_head;
+		while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &u->cqes[head & *u->cq_mask];
+			if (cqe->res != io->bs) {
+				errno = -cqe->res;
+				io_fail("io_uring op", cqe->res, io->bs);
+			}
+			hist_record(&io->lat, now - io->issued[cqe->user_data]);
+			free_bufs[nfree++] = cqe->user_data;
+			head++;
+			done++;
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+static const struct io_engine io_engines[NUM_IO_ENGINE] = {
+	[IO_BUFFERED]	= { "buffered", NULL, io_sync_pass },
+	[IO_DIRECT]	= { "direct", NULL, io_sync_pass },
+	[IO_PWRITEV]	= { "pwritev", io_vec_init, io_vec_pass },
+	[IO_URING]	= { "uring", io_uring_init, io_uring_pass },
+};
+
+/*
+ * Create the proc's file in dir and its buffers. When the mix has reads
+ * the file is written out once up front so they hit real blocks.
+ */
+static void
+io_open(struct io_ctx *io, const char *dir)
+{
+	char path[PATH_MAX];
+	off_t off;
+	ssize_t ret;
+	int i, j;
+
+	snprintf(path, sizeof(path), "%s/tmpXXXXXXXXXX", dir);
+	io->fd = mkostemp(path, io->direct ? O_DIRECT : 0);
+	if (io->fd == -1) {
+		fprintf(stderr, "Failed to open tempfile in %s: %s\n", dir,
+		    strerror(errno));
+		exit(1);
+	}
+	unlink(path);
+
+	io->bufs = calloc(io->depth, sizeof(*io->bufs));
+	io->issued = calloc(io->depth, sizeof(*io->issued));
+	if (io->bufs == NULL || io->issued == NULL) {
+		fprintf(stderr, "Failed to allocate I/O buffer\n");
+		exit(1);
+	}
+	for (i = 0; i < io->depth; i++) {
+		if (posix_memalign((void **)&io->bufs[i], 4096, io->bs) != 0) {
+			fprintf(stderr, "Failed to allocate I/O buffer\n");
+			exit(1);
+		}
+		for (j = 0; j < io->bs; j++)
+			io->bufs[i][j] = random();
+	}
+
+	if (io->rwmix > 0)
+		for (off = 0; off < (off_t)io->count * io->bs; off += io->bs) {
+			ret = pwriten(io->fd, io->bufs[0], io->bs, off);
+			if (ret != io->bs) {
+				if (io->direct && ret < 0 && errno == EINVAL) {
+					fprintf(stderr, "%s does not support "
+					    "O_DIRECT, see --io-dir\n", dir);
+					exit(1);
+				}
+				io_fail("write", ret, io->bs);
+			}
+		}
+
+	if (io_engines[io->engine].init != NULL)
+		io_engines[io->engine].init(io);
+}
+
+/*
+ * One pass of io_count ops, each one timed into io->lat, and the
+ * fdatasync if flush is set. Write only passes start from an empty file.
+ */
+static void
+io_pass(struct io_ctx *io, int flush, struct io_report *r)
+{
+	static const double pcts[] = { 50.0, 99.0 };
+	uint64_t start, end, v[2];
+
+	if (io->rwmix == 0 && ftruncate(io->fd, 0) != 0) {
+		perror("ftruncate");
+		exit(1);
+	}
+	io->next = 0;
+	hist_reset(&io->lat);
+
+	start = get_time();
+	io_engines[io->engine].pass(io);
+
+	/* Include the sync in the time calc to include time to
+	 * flush the buffer cache.
+	 */
+	r->sync = 0;
+	if (flush) {
+		r->sync = get_time();
+		fdatasync(io->fd);
+		r->sync = get_time() - r->sync;
+	}
+	end = get_time();
+
+	hist_percentiles(&io->lat, pcts, 2, v);
+	r->t = end;
+	r->bytes = (double)io->bs * (double)io->count;
+	r->us = NS_TO_US(end - start);
+	r->ops = io->count;	/* Blocks; a pwritev call is one sample. */
+	r->lat_p50 = v[0];
+	r->lat_p99 = v[1];
+	r->lat_max = io->lat.max;
+}
+
+/*
+ * Memory pressure procs for --mem-procs. Each one maps a --mem-size
+ * region, faults it in one chunk at a time and unmaps it again, over
+ * and over. With --mem-thp the region is 2M aligned and madvise()d
+ * MADV_HUGEPAGE so faults need huge pages and drive compaction. With
+ * --mem-rss each proc also holds that much resident memory, touching
+ * it again every window so it stays active and the churn has to come
+ * from reclaim. Every window of about a second is reported: fault rate
+ * and how long each chunk took to map and fault in.
+ */
+#define MEM_CHUNK	(2 << 20)	/* Timed unit; one huge page. */
+#define MEM_WINDOW_NS	1000000000ULL
+#define DFLT_MEM_SIZE	64		/* MB */
+
+struct mem_load {
+	size_t		size;		/* Churned per pass. */
+	size_t		rss;		/* Held resident. */
+	int		thp;
+	int		wait;		/* ms between windows. */
+	char		*held;
+	struct hist	lat;
+};
+
+static void
+mem_touch(char *p, size_t len)
+{
+	size_t off;
+	long pagesz = sysconf(_SC_PAGESIZE);
+
+	for (off = 0; off < len; off += pagesz)
+		p[off] = (char)off;
+}
+
+/* Map, fault in and unmap one region. Returns the munmap() time. */
+static uint64_t
+mem_pass(struct mem_load *ml)
+{
+	char *map, *p;
+	size_t len, off, chunk;
+	uint64_t start;
+
+	start = get_time();
+	len = ml->size + (ml->thp ? MEM_CHUNK : 0);
+	map = mmap(NULL, len, PROT_READ|PROT_WRITE,
+	    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	p = map;
+	if (ml->thp) {
+		p = (char *)(((uintptr_t)map + MEM_CHUNK - 1) &
+		    ~((uintptr_t)MEM_CHUNK - 1));
+		madvise(p, ml->size, MADV_HUGEPAGE);
+	}
+
+	/* The first chunk's time includes the mmap(). */
+	for (off = 0; off < ml->size; off += chunk) {
+		chunk = ml->size - off < MEM_CHUNK ? ml->size - off :
+		    MEM_CHUNK;
+		mem_touch(p + off, chunk);
+		hist_record(&ml->lat, get_time() - start);
+		start = get_time();
+	}
+
+	start = get_time();
+	munmap(map, len);
+
+	return get_time() - start;
+}
+
+static void
+mem_load_run(struct mem_load *ml, int index, struct arena_slot *slot)
+{
+	static const double pcts[] = { 50.0, 99.0 };
+	struct mem_report r;
+	struct rusage ru0, ru1;
+	uint64_t start, now, unmap, v[2];
+	double bytes;
+
+	if (ml->rss > 0) {
+		ml->held = mmap(NULL, ml->rss, PROT_READ|PROT_WRITE,
+		    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (ml->held == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+
+	while (1) {
+		if (ml->held != NULL)
+			mem_touch(ml->held, ml->rss);
+
+		hist_reset(&ml->lat);
+		getrusage(RUSAGE_SELF, &ru0);
+		r.unmap_max = 0;
+		bytes = 0;
+		start = now = get_time();
+		while (now - start < MEM_WINDOW_NS) {
+			unmap = mem_pass(ml);
+			if (unmap > r.unmap_max)
+				r.unmap_max = unmap;
+			bytes += ml->size;
+			now = get_time();
+		}
+		getrusage(RUSAGE_SELF, &ru1);
+
+		hist_percentiles(&ml->lat, pcts, 2, v);
+		r.t = now;
+		r.pid = getpid();
+		r.index = index;
+		r.bytes = bytes;
+		r.us = NS_TO_US(now - start);
+		r.minflt = ru1.ru_minflt - ru0.ru_minflt;
+		r.majflt = ru1.ru_majflt - ru0.ru_majflt;
+		r.lat_p50 = v[0];
+		r.lat_p99 = v[1];
+		r.lat_max = ml->lat.max;
+		mem_report_publish(slot, &r);
+
+		if (ml->wait > 0)
+			usleep(ml->wait * 1000);
+	}
+}
+
+/*
+ * Network procs for --net-procs, to load the NET_RX softirq without a
+ * NIC. Each one has a receiver on 127.0.0.1 and a sender thread
+ * feeding it --net-size messages at --net-rate per second (or as fast
+ * as it can) over UDP, or one TCP connection. Every message carries
+ * the time it was sent, so the receiver reports per-message latency
+ * next to pps and Gbps about every second. The receiving sockets are
+ * all bound by main() before forking; with --net-reuseport they share
+ * one SO_REUSEPORT port, and the kernel fans the senders' flows out
+ * over them rather than each sender feeding its own proc. With
+ * --net-busy-poll the receivers set SO_BUSY_POLL and spin on epoll
+ * instead of sleeping in it.
+ */
+#define NET_WINDOW_NS	1000000000ULL
+#define DFLT_NET_SIZE	1024		/* bytes */
+#define NET_MAX_SIZE	65507		/* Largest UDP payload. */
+
+struct net_load {
+	int		tcp;
+	int		size;
+	int		rate;		/* Messages/s, 0: unlimited. */
+	int		reuseport;
+	int		busy_poll;	/* us, 0: off. */
+	int		fd;		/* Receiving or listening socket. */
+	int		port;
+	uint64_t	sent, errors;	/* Updated by the sender thread. */
+	struct hist	lat;
+};
+
+/* A socket the receiver reads, with any partial TCP message so far. */
+struct net_conn {
+	int		fd;
+	int		off;		/* Bytes of the message in buf. */
+	char		buf[];
+};
+
+/* Bind a receiving socket on 127.0.0.1:port; port 0 picks one. */
+static int
+net_socket(struct net_load *nl, int port, int *portp)
+{
+	struct sockaddr_in sin;
+	socklen_t len;
+	int fd, one = 1;
 
-#define DFLT_TIMERFREQ	10000	/* us */
+	fd = socket(AF_INET, (nl->tcp ? SOCK_STREAM : SOCK_DGRAM) |
+	    SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		perror("socket");
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (nl->reuseport &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+		perror("SO_REUSEPORT");
+		exit(1);
+	}
 
-#define DFLT_IO_BS	16384
-#define DFLT_IO_COUNT	20000
-#define DFLT_IO_WAIT	4	/* seconds */
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	len = sizeof(sin);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0 ||
+	    (nl->tcp && listen(fd, 128) != 0) ||
+	    getsockname(fd, (struct sockaddr *)&sin, &len) != 0) {
+		fprintf(stderr, "Failed to bind 127.0.0.1:%d: %s\n", port,
+		    strerror(errno));
+		exit(1);
+	}
+	*portp = ntohs(sin.sin_port);
 
-static ssize_t
-readn(int fd, void *buf, size_t count)
+	return fd;
+}
+
+static void
+net_busy_poll(struct net_load *nl, int fd)
 {
-	size_t r, toread;
 
-	toread = count;
-	while (toread > 0) {
-		r = read(fd, buf + (count - toread), toread);
-		if (r <= 0) {
-			fprintf(stderr, "Read returned %zd\n",
-			    r);
-			return count - toread;
+	if (nl->busy_poll > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+	    &nl->busy_poll, sizeof(nl->busy_poll)) != 0)
+		fprintf(stderr, "SO_BUSY_POLL: %s\n", strerror(errno));
+}
+
+static void *
+net_sender(void *arg)
+{
+	struct net_load *nl = arg;
+	struct sockaddr_in sin;
+	struct timespec ts;
+	uint64_t start, now, due, n;
+	char *buf;
+	int fd, one = 1;
+
+	buf = calloc(1, nl->size);
+	fd = socket(AF_INET, (nl->tcp ? SOCK_STREAM : SOCK_DGRAM) |
+	    SOCK_CLOEXEC, 0);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(nl->port);
+	if (buf == NULL || fd == -1 ||
+	    connect(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+		fprintf(stderr, "Failed to connect to 127.0.0.1:%d: %s\n",
+		    nl->port, strerror(errno));
+		exit(1);
+	}
+	if (nl->tcp)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	start = get_time();
+	for (n = 0;; n++) {
+		/* Sleep to each message's due time; send at once when behind. */
+		if (nl->rate > 0) {
+			due = start + n * 1000000000ULL / nl->rate;
+			now = get_time();
+			if (now < due) {
+				ns_to_timespec(due - now, &ts);
+				nanosleep(&ts, NULL);
+			}
 		}
 
-		toread -= r;
+		now = get_time();
+		memcpy(buf, &now, sizeof(now));
+		if (send(fd, buf, nl->size, 0) == nl->size)
+			__atomic_add_fetch(&nl->sent, 1, __ATOMIC_RELAXED);
+		else
+			__atomic_add_fetch(&nl->errors, 1, __ATOMIC_RELAXED);
 	}
 
-	return count;
+	return NULL;
 }
 
-static ssize_t
-writen(int fd, void *buf, size_t count)
+static struct net_conn *
+net_conn_new(struct net_load *nl, int fd)
 {
-	size_t r, towrite;
+	struct net_conn *c;
 
-	towrite = count;
-	while (towrite > 0) {
-		r = write(fd, buf + (count - towrite), towrite);
-		if (r <= 0) {
-			fprintf(stderr, "Write returned %zd\n",
-			    r);
-			return count - towrite;
-		}
+	c = malloc(sizeof(*c) + nl->size);
+	if (c == NULL) {
+		perror("net proc");
+		exit(1);
+	}
+	c->fd = fd;
+	c->off = 0;
 
-		towrite -= r;
+	return c;
+}
+
+/*
+ * Receive all that is ready on c, until EAGAIN. A TCP read can end
+ * inside a message, so c->off carries the partial message over to the
+ * next wakeup. Returns the messages, -1 on EOF or error.
+ */
+static int
+net_recv(struct net_load *nl, struct net_conn *c)
+{
+	uint64_t stamp, now;
+	ssize_t n;
+	int msgs;
+
+	msgs = 0;
+	while (1) {
+		n = recv(c->fd, c->buf + c->off, nl->size - c->off, 0);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && errno == EAGAIN)
+			break;
+		if (n == -1 || (n == 0 && nl->tcp))
+			return -1;
+		if (nl->tcp) {
+			c->off += n;
+			if (c->off < nl->size)
+				continue;
+			c->off = 0;
+		} else if (n < (ssize_t)sizeof(stamp))
+			continue;
+		now = get_time();
+		memcpy(&stamp, c->buf, sizeof(stamp));
+		hist_record(&nl->lat, now > stamp ? now - stamp : 0);
+		msgs++;
 	}
 
-	return count;
+	return msgs;
+}
+
+static void
+net_load_run(struct net_load *nl, int index, struct arena_slot *slot)
+{
+	static const double pcts[] = { 50.0, 99.0 };
+	struct epoll_event evs[64], ev;
+	struct net_conn *lc, *c;
+	struct net_report r;
+	pthread_t thr;
+	uint64_t start, now, sent, errors, v[2];
+	int efd, fd, i, n, ret;
+
+	efd = epoll_create1(EPOLL_CLOEXEC);
+	if (efd == -1) {
+		perror("net proc");
+		exit(1);
+	}
+	lc = net_conn_new(nl, nl->fd);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = lc;
+	epoll_ctl(efd, EPOLL_CTL_ADD, nl->fd, &ev);
+	net_busy_poll(nl, nl->fd);
+
+	ret = pthread_create(&thr, NULL, net_sender, nl);
+	if (ret != 0) {
+		fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+		exit(1);
+	}
+
+	sent = errors = 0;
+	while (1) {
+		hist_reset(&nl->lat);
+		start = now = get_time();
+		while (now - start < NET_WINDOW_NS) {
+			n = epoll_wait(efd, evs, 64, nl->busy_poll > 0 ? 0 :
+			    100);
+			for (i = 0; i < n; i++) {
+				c = evs[i].data.ptr;
+				if (nl->tcp && c == lc) {
+					while ((fd = accept4(nl->fd, NULL, NULL,
+					    SOCK_NONBLOCK|SOCK_CLOEXEC)) != -1) {
+						net_busy_poll(nl, fd);
+						ev.data.ptr = net_conn_new(nl, fd);
+						epoll_ctl(efd, EPOLL_CTL_ADD, fd,
+						    &ev);
+					}
+				} else if (net_recv(nl, c) == -1 && c != lc) {
+					epoll_ctl(efd, EPOLL_CTL_DEL, c->fd, NULL);
+					close(c->fd);
+					free(c);
+				}
+			}
+			now = get_time();
+		}
+
+		hist_percentiles(&nl->lat, pcts, 2, v);
+		r.t = now;
+		r.pid = getpid();
+		r.index = index;
+		r.tcp = nl->tcp;
+		r.msgs = nl->lat.total;
+		r.bytes = (double)nl->lat.total * nl->size;
+		r.us = NS_TO_US(now - start);
+		r.sent = __atomic_load_n(&nl->sent, __ATOMIC_RELAXED);
+		r.errors = __atomic_load_n(&nl->errors, __ATOMIC_RELAXED);
+		r.sent -= sent;
+		r.errors -= errors;
+		sent += r.sent;
+		errors += r.errors;
+		r.lat_p50 = v[0];
+		r.lat_p99 = v[1];
+		r.lat_max = nl->lat.max;
+		net_report_publish(slot, &r);
+	}
 }
 
+/*
+ * --analyze: stream a --record trace back through iter_update(), so
+ * windows (--iterations), --csv and --hist-dump behave as in a live run,
+ * then print whole-trace percentiles for the --pct list. --export
+ * writes one CSV row per tick. Records are read in large sequential
+ * chunks, so this runs at about disk speed.
+ */
+#define TRACE_READ_RECS	65536
+#define MAX_PCTS	16
+
+static double analyze_pcts[MAX_PCTS];
+static int nanalyze_pcts;
+
+/*
+ * Parse an ascending list of percentiles like "50,99,99.999" into
+ * analyze_pcts[]. Returns the count, or -1 if the list is malformed.
+ */
 static int
-write_fd(int fd, const char *fmt, ...)
+parse_pct_list(const char *list)
 {
-	va_list ap;
-	char buf[4096];
-	int ret;
+	const char *p;
+	char *end;
+	double v;
+	int n;
 
-	va_start(ap, fmt);
-	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
-	va_end(ap);
+	n = 0;
+	p = list;
+	while (*p != '\0') {
+		v = strtod(p, &end);
+		if (end == p || v <= 0.0 || v > 100.0 || n == MAX_PCTS ||
+		    (n > 0 && v <= analyze_pcts[n - 1]))
+			return -1;
+		analyze_pcts[n++] = v;
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -1;
+		p = end;
+	}
 
-	/* Assumes O_APPEND, so don't do writen(). */
-	write(fd, buf, strlen(buf));
+	return n;
+}
 
-	return ret;
+/*
+ * Replay the trace at path into a new timer_state, whose run histograms
+ * then cover the whole trace. *lostp gets the ticks the ring dropped.
+ */
+static struct timer_state *
+trace_replay(const char *path, int iters_set, const char *export_path,
+    uint64_t *lostp)
+{
+	struct trace_hdr hdr;
+	struct trace_rec *buf;
+	struct timer_state *st;
+	uint64_t left, lost, prev, gap, late, ideal;
+	uint32_t lost32;
+	size_t i, n;
+	ssize_t len;
+	FILE *ef;
+	int fd, b, c;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Failed to open: %s\n", path);
+		exit(1);
+	}
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+	    hdr.version != TRACE_VERSION ||
+	    hdr.rec_size != sizeof(struct trace_rec)) {
+		fprintf(stderr, "Not a version %d trace: %s\n", TRACE_VERSION,
+		    path);
+		exit(1);
+	}
+
+	for (b = 0; b < NUM_TICK; b++)
+		if (strncmp(hdr.backend, tick_backends[b].name,
+		    sizeof(hdr.backend)) == 0)
+			break;
+	for (c = 0; c < NUM_CLK; c++)
+		if (strncmp(hdr.clock, clock_srcs[c].name,
+		    sizeof(hdr.clock)) == 0)
+			break;
+	if (b == NUM_TICK || c == NUM_CLK || hdr.period == 0) {
+		fprintf(stderr, "Corrupt trace header: %s\n", path);
+		exit(1);
+	}
+
+	/* Replay with the parameters the trace was recorded with. */
+	clock_src = c;
+	clock_overhead = hdr.clock_overhead;
+	prog_start = hdr.prog_start;
+	timerfreq = hdr.period / 1000;
+	if (!iters_set)
+		iters = hdr.iters;
+
+	st = timer_state_alloc(hdr.index);
+	st->offline = 1;
+	st->tid = hdr.pid;
+	st->cpu = hdr.cpu;
+	st->backend = b;
+	st->sched_start = hdr.sched_start;
+	st->sched_period = hdr.period;
+
+	printf("Trace: %s, Timer: %d, P: %d, CPU: %d, Clock: %s, "
+	    "Backend: %s, Freq: %d us, Ticks: %" PRIu64 "%s\n",
+	    path, hdr.index, hdr.pid, hdr.cpu, clock_srcs[c].name,
+	    tick_backends[b].name, timerfreq, hdr.nrecs,
+	    hdr.truncated != 0 ? " (truncated)" : "");
+	if (hdr.sched[0] != '\0')
+		printf("Trace: Sched: %.*s, Prio: %d, Mlockall: %s, "
+		    "Prefault: %s, DMA latency: %d\n",
+		    (int)sizeof(hdr.sched), hdr.sched, hdr.sched_prio,
+		    hdr.mlockall ? "on" : "off", hdr.prefault ? "on" : "off",
+		    hdr.dma_latency);
+	fflush(stdout);
+
+	ef = NULL;
+	if (export_path != NULL) {
+		ef = fopen(export_path, "w");
+		if (ef == NULL) {
+			fprintf(stderr, "Failed to open: %s\n", export_path);
+			exit(1);
+		}
+		setvbuf(ef, NULL, _IOFBF, 1 << 20);
+		fprintf(ef, "Seq,Stamp_ns,Gap_ns,Late_ns,Overrun,Lost\n");
+	}
+
+	buf = malloc(TRACE_READ_RECS * sizeof(*buf));
+	if (buf == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+
+	posix_fadvise(fd, hdr.hdr_size, 0, POSIX_FADV_SEQUENTIAL);
+	if (lseek(fd, hdr.hdr_size, SEEK_SET) == -1) {
+		perror("lseek");
+		exit(1);
+	}
+
+	left = hdr.nrecs;
+	lost = 0;
+	lost32 = 0;
+	prev = hdr.sched_start;
+	while (left > 0) {
+		n = left < TRACE_READ_RECS ? left : TRACE_READ_RECS;
+		len = read(fd, buf, n * sizeof(*buf));
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0) {
+			fprintf(stderr, "Trace ends %" PRIu64 " records "
+			    "short: %s\n", left, path);
+			break;
+		}
+		n = len / sizeof(*buf);
+
+		for (i = 0; i < n; i++) {
+			/* Ring drops are recorded mod 2^32. */
+			lost += (uint32_t)(buf[i].lost - lost32);
+			lost32 = buf[i].lost;
+			st->ring.dropped = lost;
+
+			iter_update(st, buf[i].stamp, buf[i].overrun);
+
+			if (ef == NULL)
+				continue;
+
+			gap = buf[i].stamp - prev;
+			gap = gap > clock_overhead ? gap - clock_overhead : 0;
+			ideal = st->sched_start + st->tick_seq *
+			    st->sched_period;
+			late = buf[i].stamp > ideal ? buf[i].stamp - ideal : 0;
+			fprintf(ef, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%"
+			    PRIu64 ",%u,%" PRIu64 "\n", st->tick_seq,
+			    buf[i].stamp, gap, late, buf[i].overrun, lost);
+			prev = buf[i].stamp;
+		}
+		left -= n;
+	}
+
+	if (st->spikes != NULL)
+		spike_flush(st);
+
+	if (ef != NULL && fclose(ef) != 0) {
+		fprintf(stderr, "Failed to write: %s\n", export_path);
+		exit(1);
+	}
+	free(buf);
+	close(fd);
+
+	*lostp = lost;
+
+	return st;
 }
 
-static uint64_t
-get_time(void)
+static int
+trace_analyze(const char *path, int iters_set, const char *export_path)
 {
-	uint64_t current_time=0;
-	static uint64_t last_time = 0;
-	struct timeval time_val;
+	struct timer_state *st;
+	uint64_t pv[MAX_PCTS], lv[MAX_PCTS];
+	uint64_t lost;
+	int c;
+
+	st = trace_replay(path, iters_set, export_path, &lost);
 
-	gettimeofday(&time_val, NULL);
-	current_time = time_val.tv_sec * 1000000LL + time_val.tv_usec;
-  
-	if (current_time < last_time)
-		return last_time;
+	hist_percentiles(&st->run_hist, analyze_pcts, nanalyze_pcts, pv);
+	hist_percentiles(&st->run_late_hist, analyze_pcts, nanalyze_pcts, lv);
 
-	last_time = current_time;
+	printf("Total: Ticks: %" PRIu64 ", Dropped: %" PRIu64 ", Lost: %"
+	    PRIu64, st->run_hist.total, st->run_overruns, lost);
+	for (c = 0; c < nanalyze_pcts; c++)
+		printf(", p%g: %.3f", analyze_pcts[c], NS_TO_US(pv[c]));
+	printf(", Max: %.3f", NS_TO_US(st->run_hist.max));
+	for (c = 0; c < nanalyze_pcts; c++)
+		printf(", Late p%g: %.3f", analyze_pcts[c], NS_TO_US(lv[c]));
+	printf(", Late Max: %.3f\n", NS_TO_US(st->run_late_hist.max));
 
-	return current_time;
+	timer_dump_hists(st);
+
+	return 0;
 }
 
-static uint64_t prog_start;
-static int iters, timerfreq, yieldtime, yieldpct, tcsv_fd, icsv_fd;
+/*
+ * --baseline/--compare: judge a candidate run against a baseline. Each
+ * side is one or more --hist-dump histograms or --record traces, merged
+ * (the bucket layout is fixed). The --pct percentiles are compared and
+ * the two distributions tested with Kolmogorov-Smirnov and two-sample
+ * Anderson-Darling at bucket resolution. A regression beyond any
+ * threshold exits with COMPARE_EXIT_FAIL.
+ */
+#define MAX_COMPARE_FILES	64
+#define DFLT_MAX_REGRESS	10
+#define DFLT_MAX_KS		0.05
+#define COMPARE_EXIT_FAIL	2
+#define COMPARE_MIN_TAIL	10	/* Ticks above a judged percentile. */
 
-struct cpu_stat {
-	uint64_t	user;
-	uint64_t	lowp;
-	uint64_t	sys;
-	uint64_t	idle;
-	uint64_t	iowait;
-	uint64_t	irq;
-	uint64_t	softirq;
-	uint64_t	steal;
-};
+enum { CMP_BASE, CMP_NEW };
 
-static inline int
-read_proc_stat(struct cpu_stat *cpu)
+static const char *compare_files[2][MAX_COMPARE_FILES];
+static int ncompare_files[2];
+static int compare_late;		/* Use lateness from traces. */
+static double max_regress = DFLT_MAX_REGRESS;	/* Percent. */
+static double max_ks = DFLT_MAX_KS;
+static double max_ad;			/* Standardized T, 0 if off. */
+
+/* Merge a histogram written by hist_dump_file() into h. */
+static void
+hist_load_file(struct hist *h, const char *path)
 {
+	struct hist *f;
+	uint64_t lo, hi, count, total, min, max;
+	char line[256];
 	FILE *fp;
-	int num;
-	static int printed_err = 0;
+	int bits;
 
-	fp = fopen("/proc/stat", "r");
+	fp = fopen(path, "r");
 	if (fp == NULL) {
-		fprintf(stderr, "Can not open /proc/stat\n");
+		fprintf(stderr, "Failed to open: %s\n", path);
 		exit(1);
 	}
+	f = malloc(sizeof(*f));
+	if (f == NULL) {
+		fprintf(stderr, "Failed to allocate memory\n");
+		exit(1);
+	}
+	hist_reset(f);
 
-	num = fscanf(fp, "cpu %ld %ld %ld %ld %ld %ld %ld %ld",
-	    &cpu->user, &cpu->lowp, &cpu->sys,
-	    &cpu->idle, &cpu->iowait, &cpu->irq, &cpu->softirq,
-	    &cpu->steal);
-	if (num != 8) {
-		if (!printed_err) {
-			fprintf(stderr,
-				"Can not read 8 items from /proc/stat\n");
-			printed_err = 1;
-		}
-		fclose(fp);
-		return 1;
+	if (fgets(line, sizeof(line), fp) == NULL ||
+	    strcmp(line, "# timer_stability histogram\n") != 0 ||
+	    fgets(line, sizeof(line), fp) == NULL ||
+	    sscanf(line, "# pid %*d proc %*d unit %*s sub_bits %d total %"
+	    SCNu64 " min %" SCNu64 " max %" SCNu64, &bits, &total, &min,
+	    &max) != 4 || bits != HIST_SUB_BITS ||
+	    fgets(line, sizeof(line), fp) == NULL) {
+		fprintf(stderr, "Not a histogram dump: %s\n", path);
+		exit(1);
 	}
 
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &lo, &hi,
+		    &count) != 3 || hist_bucket_lo(hist_index(lo)) != lo) {
+			fprintf(stderr, "Corrupt histogram dump: %s\n", path);
+			exit(1);
+		}
+		f->counts[hist_index(lo)] += count;
+		f->total += count;
+	}
 	fclose(fp);
 
-	return 0;
+	if (f->total != total) {
+		fprintf(stderr, "Histogram dump is short: %s\n", path);
+		exit(1);
+	}
+	if (total != 0) {
+		f->min = min;
+		f->max = max;
+	}
+	hist_merge(h, f);
+	free(f);
 }
 
-static inline uint64_t
-total_proc_stat_time(struct cpu_stat *cpu)
+/* Build one side of the comparison from its files. */
+static void
+compare_load(struct hist *h, int side)
 {
+	struct timer_state *st;
+	char magic[sizeof(TRACE_MAGIC)];
+	uint64_t lost;
+	FILE *fp;
+	int i, is_trace;
 
-	return cpu->user + cpu->lowp + cpu->sys + cpu->idle +
-	    cpu->iowait + cpu->irq + cpu->softirq + cpu->steal;
-}
+	hist_reset(h);
+	for (i = 0; i < ncompare_files[side]; i++) {
+		fp = fopen(compare_files[side][i], "r");
+		if (fp == NULL) {
+			fprintf(stderr, "Failed to open: %s\n",
+			    compare_files[side][i]);
+			exit(1);
+		}
+		is_trace = fread(magic, sizeof(magic), 1, fp) == 1 &&
+		    memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+		fclose(fp);
 
+		if (!is_trace) {
+			hist_load_file(h, compare_files[side][i]);
+			continue;
+		}
 
-static inline void
-iter_update(void)
-{
-	static uint64_t last_time = 0, min = 0, max = 0;
-	static uint64_t gaps = 0;
-	static uint64_t gaps_sq = 0;
-	static uint64_t count = 0;
-	static int pid = 0;
-	static struct timespec stime;
-	static int use_proc_stat = 0;
-	uint64_t curr_time;
-	uint64_t gap;
-	struct cpu_stat cpu_start, cpu_end;
-	long r;
-
-	if (last_time == 0) {
-		/* Reset all tracking variables. */
-		gaps = gaps_sq = 0;
-		count = 0;
-		min = 1000000000;
-		max = 0;
-		pid = getpid();
-		if (read_proc_stat(&cpu_start) != 0)
-			use_proc_stat = 0;
-		else
-			use_proc_stat = 1;
-		curr_time = get_time();
-		last_time = curr_time;
+		st = trace_replay(compare_files[side][i], 1, NULL, &lost);
+		hist_merge(h, compare_late ? &st->run_late_hist :
+		    &st->run_hist);
+	}
+}
 
-		if (yieldtime != -1) {
-			stime.tv_sec = yieldtime / 1000000;
-			stime.tv_nsec = (yieldtime % 1000000) * 1000;
+/*
+ * Kolmogorov-Smirnov over the shared buckets. d is the two-sided
+ * statistic and dplus how far the candidate's CDF lags the baseline's,
+ * i.e. the one-sided statistic for the candidate being slower. Returns
+ * the asymptotic p-value of d.
+ */
+static double
+compare_ks(const struct hist *a, const struct hist *b, double *d,
+    double *dplus)
+{
+	double fa, fb, ne, lambda, p, term;
+	uint64_t ca, cb;
+	unsigned idx;
+	int j;
 
-			r = random() % 10000;
+	*d = *dplus = 0;
+	ca = cb = 0;
+	for (idx = 0; idx < HIST_BUCKETS; idx++) {
+		ca += a->counts[idx];
+		cb += b->counts[idx];
+		fa = (double)ca / a->total;
+		fb = (double)cb / b->total;
+		if (fabs(fa - fb) > *d)
+			*d = fabs(fa - fb);
+		if (fa - fb > *dplus)
+			*dplus = fa - fb;
+	}
 
-			if (r < yieldpct * 100)
-				/* Ensure we yield in the first time sample. */
-				nanosleep(&stime, NULL);
-		}
+	ne = (double)a->total * b->total / (a->total + b->total);
+	lambda = (sqrt(ne) + 0.12 + 0.11 / sqrt(ne)) * *d;
+	if (lambda < 0.3)
+		return 1.0;
+	p = 0;
+	for (j = 1; j <= 100; j++) {
+		term = 2 * exp(-2.0 * j * j * lambda * lambda);
+		p += j % 2 ? term : -term;
+		if (term < 1e-12)
+			break;
+	}
 
-		/* No timer interval yet, so exit. */
-		return;
-	} else
-		curr_time = get_time();
+	return p < 0 ? 0 : p > 1 ? 1 : p;
+}
 
-	if (yieldtime != -1) {
-		r = random() % 10000;
+/*
+ * Two-sample Anderson-Darling A2akN for tied data (Scholz and Stephens,
+ * 1987), with every bucket one tied value. Returns the standardized T,
+ * using the large N variance of the statistic.
+ */
+static double
+compare_ad(const struct hist *a, const struct hist *b, double *a2)
+{
+	const struct hist *s[2] = { a, b };
+	double n, ni, l, bj, baj, maj, denom, sum, h, g, var;
+	uint64_t m[2];
+	unsigned idx;
+	int i;
 
-		if (r < yieldpct * 100)
-			nanosleep(&stime, NULL);
+	n = (double)a->total + b->total;
+	m[0] = m[1] = 0;
+	bj = 0;
+	sum = 0;
+	for (idx = 0; idx < HIST_BUCKETS; idx++) {
+		l = (double)a->counts[idx] + b->counts[idx];
+		if (l == 0)
+			continue;
+		bj += l;
+		baj = bj - l / 2;
+		denom = baj * (n - baj) - n * l / 4;
+		for (i = 0; i < 2; i++) {
+			m[i] += s[i]->counts[idx];
+			if (denom <= 0)
+				continue;
+			ni = s[i]->total;
+			maj = m[i] - s[i]->counts[idx] / 2.0;
+			sum += l / ni * (n * maj - ni * baj) *
+			    (n * maj - ni * baj) / denom;
+		}
 	}
+	*a2 = sum * (n - 1) / (n * n);
 
-	gap = curr_time - last_time;
-	gaps += gap;
-	gaps_sq += gap * gap;
-	count++;
+	/* sigma^2 tends to a of Scholz and Stephens as N grows, k = 2. */
+	h = 1.0 / a->total + 1.0 / b->total;
+	g = M_PI * M_PI / 6;
+	var = (4 * g - 6) + (10 - 6 * g) * h;
 
-	if (gap > max)
-		max = gap;
-	if (gap < min)
-		min = gap;
+	return (*a2 - 1) / sqrt(var);
+}
 
-	last_time = curr_time;
+/* Significance of T for k = 2 from Scholz and Stephens' table. */
+static const char *
+compare_ad_sig(double t)
+{
 
-	if (count == iters) {
-		double std_dev;
-		uint64_t elapsed_hz, elapsed_st_hz;
-		double steal_pct;
+	if (t >= 3.752)
+		return "p < 0.01";
+	if (t >= 2.719)
+		return "p < 0.025";
+	if (t >= 1.960)
+		return "p < 0.05";
+	if (t >= 1.225)
+		return "p < 0.1";
+	return "p >= 0.1";
+}
 
-		if (use_proc_stat) {
-			read_proc_stat(&cpu_end);
+static int
+compare_runs(void)
+{
+	struct hist *h[2];
+	uint64_t pv[2][MAX_PCTS];
+	double delta, d, dplus, ks_p, a2, t, tail;
+	int i, fail, judged;
 
-			elapsed_hz = total_proc_stat_time(&cpu_end) -
-			    total_proc_stat_time(&cpu_start);
-			elapsed_st_hz = cpu_end.steal - cpu_start.steal;
-		} else {
-			elapsed_hz = 0;
-			elapsed_st_hz = 0;
+	/* Replays only need the whole-trace histograms. */
+	iters = INT_MAX;
+
+	for (i = 0; i < 2; i++) {
+		h[i] = malloc(sizeof(struct hist));
+		if (h[i] == NULL) {
+			fprintf(stderr, "Failed to allocate memory\n");
+			exit(1);
+		}
+		compare_load(h[i], i);
+		if (h[i]->total == 0) {
+			fprintf(stderr, "No ticks in the %s\n",
+			    i == CMP_BASE ? "baseline" : "candidate");
+			exit(1);
 		}
+		hist_percentiles(h[i], analyze_pcts, nanalyze_pcts, pv[i]);
+	}
 
-		std_dev = sqrt((double)count * (double)gaps_sq -
-		    (double)gaps * (double)gaps);
-		std_dev /= (double)count;
-		steal_pct = elapsed_hz == 0 ? -0.1 :
-		    ((double)elapsed_st_hz / (double)elapsed_hz) * 100.0;
+	printf("Compare: %s, Baseline: %d files, %" PRIu64 " ticks, "
+	    "Candidate: %d files, %" PRIu64 " ticks\n",
+	    compare_late ? "lateness" : "gap", ncompare_files[CMP_BASE],
+	    h[CMP_BASE]->total, ncompare_files[CMP_NEW], h[CMP_NEW]->total);
 
-		printf("T> P: %d, I: %ld, Min: %ld, Max: %ld, Avg: %7.1f, Dev: %5.1f%% (%4.2f), Steal pct: %5.1f%%\n",
-		    pid, count, min, max, (double)gaps / (double)count,
-		    (std_dev / (double)timerfreq) * 100.0, std_dev,
-		    steal_pct);
-		fflush(stdout);
+	fail = 0;
+	for (i = 0; i <= nanalyze_pcts; i++) {
+		const char *name = "Max";
+		uint64_t vb, vn;
+		char pname[32];
 
-		if (tcsv_fd != -1)
-			write_fd(tcsv_fd,
-			    "%ld,%ld,%ld,%ld,%.1f,%.1f,%.2f,%.1f\n",
-			    (curr_time - prog_start) / 1000000,
-			    count, min, max, (double)gaps / (double)count,
-			    (std_dev / (double)timerfreq) * 100.0,
-			    std_dev, steal_pct);
+		/* The maximum is one sample; it is shown, not judged. */
+		judged = 0;
+		if (i < nanalyze_pcts) {
+			tail = (100 - analyze_pcts[i]) / 100 *
+			    (h[CMP_BASE]->total < h[CMP_NEW]->total ?
+			    h[CMP_BASE]->total : h[CMP_NEW]->total);
+			judged = tail >= COMPARE_MIN_TAIL;
+			snprintf(pname, sizeof(pname), "p%g", analyze_pcts[i]);
+			name = pname;
+			vb = pv[CMP_BASE][i];
+			vn = pv[CMP_NEW][i];
+		} else {
+			vb = h[CMP_BASE]->max;
+			vn = h[CMP_NEW]->max;
+		}
+		delta = vb != 0 ? ((double)vn - vb) * 100 / vb : 0;
 
-		last_time = 0;
+		printf("R> %s: %.3f -> %.3f (%+.1f%%)%s\n", name,
+		    NS_TO_US(vb), NS_TO_US(vn), delta,
+		    !judged ? ", not judged" :
+		    delta > max_regress ? ", REGRESSED" : "");
+		if (judged && delta > max_regress)
+			fail = 1;
 	}
-}
 
-static void
-handle_sig(int sig, siginfo_t *info, void *ctxt)
-{
+	ks_p = compare_ks(h[CMP_BASE], h[CMP_NEW], &d, &dplus);
+	t = compare_ad(h[CMP_BASE], h[CMP_NEW], &a2);
+	printf("R> KS: D: %.4f (p %.3g), D+: %.4f%s\n", d, ks_p, dplus,
+	    dplus > max_ks ? ", REGRESSED" : "");
+	printf("R> AD: A2: %.3f, T: %.3f (%s)%s\n", a2, t, compare_ad_sig(t),
+	    max_ad != 0 && t > max_ad ? ", DIFFERENT" : "");
+	if (dplus > max_ks || (max_ad != 0 && t > max_ad))
+		fail = 1;
+
+	printf("R> Result: %s\n", fail ? "FAIL" : "PASS");
+	fflush(stdout);
 
-	iter_update();
+	return fail ? COMPARE_EXIT_FAIL : 0;
 }
 
 static void
@@ -287,12 +6360,50 @@ usage(const char *name)
 	    "          [--yield <time (us)>] [--yieldpct <percentag> ] \\\n"
 	    "          [--io-procs <num>] [--io-bs <bs>] \\\n"
 	    "          [--io-count <count>] [--io-wait <secs>] \\\n"
-	    "          [--io-flush] \\\n"
+	    "          [--io-flush] [--io-engine <engine>] \\\n"
+	    "          [--io-depth <depth>] [--io-pattern seq|rand] \\\n"
+	    "          [--io-rwmix <read pct>] [--io-dir <dir>] \\\n"
+	    "          [--io-direct] \\\n"
 	    "          [--no-busy-loop] [--csv <out>] \\\n"
+	    "          [--hist-dump <out>] [--clock <source>] \\\n"
+	    "          [--threads] [--cpu-list <cpus>] \\\n"
+	    "          [--backend <name>[,<name>...]] [--aggregate] \\\n"
+	    "          [--record <out>] [--record-ticks <ticks>] \\\n"
+	    "          [--perf] [--spike-threshold <gap (us)>] \\\n"
+	    "          [--cpu-load <kernel>] [--cpu-load-size <KB>] \\\n"
+	    "          [--mem-procs <num>] [--mem-size <MB>] [--mem-thp] \\\n"
+	    "          [--mem-rss <MB>] [--mem-wait <ms>] \\\n"
+	    "          [--net-procs <num>] [--net-proto tcp|udp] \\\n"
+	    "          [--net-size <bytes>] [--net-rate <msgs/s>] \\\n"
+	    "          [--net-reuseport] [--net-busy-poll <us>] \\\n"
+	    "          [--cgroup <dir>] \\\n"
+	    "          [--cgroup-set <class>.<file>=<value>]... \\\n"
+	    "          [--sched <policy>] [--sched-prio <prio>] \\\n"
+	    "          [--sched-runtime <us>] [--mlockall] [--prefault] \\\n"
+	    "          [--dma-latency <us>] \\\n"
+	    "          [--sweep <setting>=<list>]... [--sweep-time <secs>] \\\n"
+	    "          [--converge <pct>] [--converge-err <pct>] \\\n"
+	    "          [--converge-max <secs>] [--stats-socket <path>] \\\n"
+	    "          [--timers-per-proc <num>] \\\n"
+	    "          [--timer-freqs [random:]<freq (us)>[,...]] \\\n"
+	    "          [--phase aligned|stagger|random] \\\n"
+	    "          [--launch-fanout <num>] \\\n"
+	    "          [--wakeup-test <mech>[,<mech>...]] \\\n"
+	    "          [--wakeup-cpu same|smt|socket|cross] \\\n"
 	    "          --nprocs <nprocs>\n"
 	    "\n"
 	    "       %s [--iterations <iters (#)>] [--freq <freq (us)>] \\\n"
-	    "          [--csv <out>] --use-sleep --nprocs <nprocs>\n"
+	    "          [--csv <out>] [--hist-dump <out>] \\\n"
+	    "          [--clock <source>] [--threads] [--cpu-list <cpus>] \\\n"
+	    "          --use-sleep --nprocs <nprocs>\n"
+	    "\n"
+	    "       %s [--iterations <iters (#)>] [--csv <out>] \\\n"
+	    "          [--hist-dump <out>] [--pct <pct>[,<pct>...]] \\\n"
+	    "          [--export <out.csv>] --analyze <trace>\n"
+	    "\n"
+	    "       %s [--pct <pct>[,<pct>...]] [--compare-late] \\\n"
+	    "          [--max-regress <pct>] [--max-ks <D>] [--max-ad <T>] \\\n"
+	    "          --baseline <hist|trace>... --compare <hist|trace>...\n"
 	    "\n"
 	    "  Defaults:\n"
 	    "       Print iterations: %d\n"
@@ -306,10 +6417,204 @@ usage(const char *name)
 	    "       I/O Blocksize: 16k\n"
 	    "       I/O Count: 20000\n"
 	    "       I/O Wait: 4 seconds\n"
-	    "       CSV: Output CSV format to file.timer.csv and file.io.csv.\n"
+	    "       I/O Engine: buffered (pread/pwrite). Also direct\n"
+	    "            (pread/pwrite with O_DIRECT), pwritev (preadv/pwritev\n"
+	    "            of <depth> adjacent blocks per call) and uring\n"
+	    "            (io_uring with <depth> ops in flight).\n"
+	    "       I/O Depth: 1.\n"
+	    "       I/O Pattern: seq. Blocks of one pass cover a file of\n"
+	    "            Count * Blocksize bytes in order, or at random.\n"
+	    "       I/O Read/write mix: 0, write only. Percentage of reads.\n"
+	    "       I/O Dir: /tmp. Where each I/O proc keeps its file.\n"
+	    "       I/O Direct: off. Open the file O_DIRECT for any engine.\n"
+	    "            Needs a blocksize multiple of 4k and a filesystem\n"
+	    "            that supports it (tmpfs does not).\n"
+	    "       Memory Processes: zero. Each maps, faults in and unmaps\n"
+	    "            a region over and over, and reports fault rate and\n"
+	    "            per 2M chunk allocation latency about every second.\n"
+	    "       Memory Size: %d MB. Region churned per pass.\n"
+	    "       Memory THP: off. Align regions and madvise them\n"
+	    "            MADV_HUGEPAGE to drive compaction.\n"
+	    "       Memory RSS: zero. Also hold this much resident per proc\n"
+	    "            so the churn has to come from reclaim.\n"
+	    "       Memory Wait: 0 ms between reports.\n"
+	    "       Network Processes: zero. Each sends --net-size byte\n"
+	    "            (default %d) messages to itself over loopback,\n"
+	    "            UDP or one TCP connection (--net-proto, default\n"
+	    "            udp), at --net-rate per second (default as fast\n"
+	    "            as it can), to load the NET_RX softirq. Every\n"
+	    "            second it reports received pps and Gbps and the\n"
+	    "            per-message latency from send to receive, on the\n"
+	    "            timer CSV's time axis in file.net.csv.\n"
+	    "       Network reuseport: off. If set, all receivers share one\n"
+	    "            SO_REUSEPORT port and the kernel fans the flows out\n"
+	    "            over them.\n"
+	    "       Network busy poll: off. If set, receivers set\n"
+	    "            SO_BUSY_POLL to this many us and spin instead of\n"
+	    "            sleeping.\n"
+	    "       Cgroup: off. If set to a cgroup v2 directory, e.g.\n"
+	    "            /sys/fs/cgroup/ts, timer, io, mem and net procs\n"
+	    "            each run in their own child group of it, created\n"
+	    "            if missing. --cgroup-set writes one of cpu.max,\n"
+	    "            cpu.weight, io.max, io.weight, cpuset.cpus or\n"
+	    "            cpuset.mems of a class' group, e.g.\n"
+	    "            --cgroup-set io.cpu.max=\"20000 100000\", and\n"
+	    "            enables the controller. Every report interval\n"
+	    "            prints a G> line per group (and a row in\n"
+	    "            file.cgroup.csv) with its CPU time, throttling\n"
+	    "            from cpu.stat and the share of the interval its\n"
+	    "            tasks stalled on CPU, I/O and memory per PSI.\n"
+	    "       CSV: Output CSV format to file.timer.csv and file.io.csv\n"
+	    "            (and file.mem.csv with memory processes and\n"
+	    "            file.net.csv with network processes).\n"
+	    "            Off by default.\n"
+	    "       Histogram dump: On SIGINT/SIGTERM each timer process\n"
+	    "            writes its full gap and lateness histograms to\n"
+	    "            file.<proc>.hist and file.<proc>.late.hist.\n"
 	    "            Off by default.\n"
+	    "       Clock: monotonic. One of monotonic, raw (MONOTONIC_RAW),\n"
+	    "            boottime or tsc (invariant TSC only). All times are\n"
+	    "            kept in ns and shown in us. The measured read overhead\n"
+	    "            of the clock is subtracted from every gap.\n"
+	    "       Threads: off. If set, run the <nprocs> timers as threads\n"
+	    "            of one process, each receiving its own timer signal,\n"
+	    "            and print a per-CPU jitter table on SIGINT/SIGTERM.\n"
+	    "       CPU list: none. E.g. 0-3,8. Timer <n> is pinned to the\n"
+	    "            (n mod count)th CPU of the list.\n"
+	    "       Backend: signal. How ticks are delivered: signal (POSIX\n"
+	    "            timer), sleep (relative nanosleep, same as\n"
+	    "            --use-sleep), abs-sleep (clock_nanosleep to an\n"
+	    "            absolute deadline), timerfd (blocking read) or\n"
+	    "            timerfd-epoll. Given a list, timer <n> uses the\n"
+	    "            (n mod count)th entry so they can be compared in one\n"
+	    "            run. --no-busy-loop only affects signal.\n"
+	    "       Wakeup test: off. If set, each timer ticks by a round\n"
+	    "            trip to a partner thread (--threads) or process\n"
+	    "            over futex, eventfd, pipe, unix (socketpair) or\n"
+	    "            condvar (process shared) instead: on its schedule\n"
+	    "            it wakes the partner and waits to be woken back.\n"
+	    "            Gaps are the round trips, lateness the answer's\n"
+	    "            against the schedule; all reports, CSVs and\n"
+	    "            tables work as for timers, and the names can be\n"
+	    "            mixed with timer ones in --backend to compare\n"
+	    "            both in one run.\n"
+	    "       Wakeup CPU: unpinned. If set, the timer stays on its\n"
+	    "            CPU and its partner goes on the same CPU, an SMT\n"
+	    "            sibling, another core of the same socket, or\n"
+	    "            another socket.\n"
+	    "       Aggregate: off. If set, timer and I/O procs publish their\n"
+	    "            reports through a shared memory arena instead of\n"
+	    "            writing output themselves. One collector prints them,\n"
+	    "            followed every Iterations * Frequency us by an A> line\n"
+	    "            merging all timers' histograms (and a row in\n"
+	    "            file.agg.csv), and a total on SIGINT/SIGTERM.\n"
+	    "       Sched: other (CFS). fifo and rr run each timer thread at\n"
+	    "            --sched-prio (default %d); deadline gives it\n"
+	    "            --sched-runtime us (default a quarter) of every\n"
+	    "            period; it excludes --cpu-list and wants a blocking\n"
+	    "            backend. Both need CAP_SYS_NICE.\n"
+	    "       Mlockall: off. Lock all current and future memory.\n"
+	    "       Prefault: off. Fault in %d KB of each timer's stack.\n"
+	    "       DMA latency: untouched. Hold /dev/cpu_dma_latency at this\n"
+	    "            many us for the run, keeping CPUs out of deep\n"
+	    "            C-states. These settings are printed on the Run:\n"
+	    "            line, stored in --record traces and repeated in\n"
+	    "            every timer CSV row.\n"
+	    "       Sweep: off. Each --sweep names one of freq, nprocs,\n"
+	    "            io-procs, mem-procs or yieldpct and its values,\n"
+	    "            e.g. --sweep freq=100,1000 --sweep nprocs=1-8:2.\n"
+	    "            Every combination runs as its own --aggregate run\n"
+	    "            for --sweep-time s (default %d), after which a W>\n"
+	    "            line gives its whole-run percentiles. With --csv\n"
+	    "            the cells write file.<cell>.*.csv and the matrix\n"
+	    "            goes to file.sweep.csv and file.sweep.json.\n"
+	    "       Converge: off. If set to a percentile, e.g. 99, run until\n"
+	    "            it is known to within --converge-err percent\n"
+	    "            (default %d) at 95%% confidence, or for at most\n"
+	    "            --converge-max s (default %d). Each collector\n"
+	    "            interval of --aggregate is one batch, and the\n"
+	    "            batch means estimate is printed as C> lines, so\n"
+	    "            Iterations should hold plenty of ticks beyond the\n"
+	    "            percentile. A --sweep cell that converges ends\n"
+	    "            before --sweep-time.\n"
+	    "       Stats socket: off. If set, implies --aggregate, and every\n"
+	    "            connection to this Unix socket gets a JSON\n"
+	    "            snapshot of the run so far: merged gap and\n"
+	    "            lateness histograms with percentiles, drop\n"
+	    "            counters and each proc's status and last report.\n"
+	    "       Timers per proc: 1. If more, each timer proc (signal\n"
+	    "            backend only) runs this many POSIX timers, spread\n"
+	    "            over the --timer-freqs periods (default --freq)\n"
+	    "            round-robin, or at random with \"random:\", each\n"
+	    "            timer on its own phase. T> lines cover all of a\n"
+	    "            proc's ticks; every report adds a K> line per\n"
+	    "            period (and a row in file.class.csv) with its gap\n"
+	    "            and lateness percentiles, overruns and the SigQ\n"
+	    "            signal queue use. RLIMIT_SIGPENDING is raised to\n"
+	    "            fit all timers where the hard limit allows.\n"
+	    "       Phase: off, each timer starts as soon as it is set up.\n"
+	    "            If set, all timers wait on a barrier until the last\n"
+	    "            is ready, then start %d ms later together\n"
+	    "            (aligned, to provoke thundering herd wakeups),\n"
+	    "            spread evenly over one period (stagger) or at\n"
+	    "            random offsets. The Launch: line gives how long\n"
+	    "            bringing them up took, and the Phase: line how\n"
+	    "            late their first ticks were and how far apart.\n"
+	    "       Launch fan-out: 0, main forks every timer proc. If set,\n"
+	    "            timer procs are forked as a tree where each proc\n"
+	    "            forks at most this many, which brings up\n"
+	    "            thousands of them far faster on many CPUs.\n"
+	    "       Perf: off. If set, each timer counts its own context\n"
+	    "            switches, CPU migrations and page faults, plus\n"
+	    "            cycles, instructions and LLC misses where the PMU\n"
+	    "            and perf_event_paranoid allow, and reports them per\n"
+	    "            interval next to Dev (-1: not available).\n"
+	    "       CPU load: none, the work loop just spins. Otherwise it runs\n"
+	    "            one of: stream (STREAM triad), chase (pointer chase\n"
+	    "            through random cache lines), avx2 or avx512 (FMA\n"
+	    "            chains) or lock (a mutex shared by all timers), and\n"
+	    "            reports its throughput per interval. Signal backend\n"
+	    "            with the busy loop only.\n"
+	    "       CPU load size: %d KB. Working set of stream and chase.\n"
+	    "       Spike threshold: off. If set, every gap over it is marked\n"
+	    "            in /sys/kernel/tracing/trace_marker (if writable)\n"
+	    "            and logged with its CPU, context switches and the\n"
+	    "            /proc/stat deltas of the interval so far, printed as\n"
+	    "            S> lines (and to file.spike.csv) at the next report.\n"
+	    "            At most %d spikes are logged per interval.\n"
+	    "       Record: off. If set, each timer writes every tick to the\n"
+	    "            binary trace file.<proc>, preallocated for\n"
+	    "            --record-ticks ticks (default %d). Later ticks are\n"
+	    "            counted but not recorded.\n"
+	    "       Analyze: replay a trace, reporting every --iterations\n"
+	    "            ticks (default: as recorded) and printing whole-trace\n"
+	    "            percentiles for --pct (default 50,90,99,99.9,99.99).\n"
+	    "            --export writes one CSV row per tick.\n"
+	    "       Compare: judge the merged --compare histogram dumps or\n"
+	    "            traces (gap, or lateness with --compare-late)\n"
+	    "            against the merged --baseline ones. Fails if a\n"
+	    "            --pct percentile grew by over --max-regress percent\n"
+	    "            (default %d) with at least %d ticks above it on\n"
+	    "            each side, if the one-sided KS statistic D+ of the\n"
+	    "            candidate being slower exceeds --max-ks (default\n"
+	    "            %g) or, if set, if the Anderson-Darling T exceeds\n"
+	    "            --max-ad. With millions of ticks the tests see\n"
+	    "            even harmless shifts, so gate on effect size. Exits\n"
+	    "            %d on failure.\n"
+	    "\n"
+	    "  Besides the gap to the previous tick, every tick's lateness\n"
+	    "  against its ideal expiry (start + n * freq) is reported. Ticks\n"
+	    "  the timer overran are counted as Dropped and charged the\n"
+	    "  lateness they would have seen.\n"
 	    ,
-	    name, name, DFLT_ITERS, DFLT_TIMERFREQ);
+	    name, name, name, name, DFLT_ITERS, DFLT_TIMERFREQ, DFLT_MEM_SIZE,
+	    DFLT_NET_SIZE,
+	    DFLT_SCHED_PRIO, PREFAULT_STACK >> 10, DFLT_SWEEP_TIME,
+	    DFLT_CONVERGE_ERR, DFLT_CONVERGE_MAX,
+	    (int)(LAUNCH_LEAD / 1000000), DFLT_LOAD_SIZE >> 10,
+	    SPIKE_LOG_SIZE,
+	    DFLT_RECORD_TICKS, DFLT_MAX_REGRESS, COMPARE_MIN_TAIL,
+	    DFLT_MAX_KS, COMPARE_EXIT_FAIL);
 	exit(1);
 }
 
@@ -317,16 +6622,23 @@ int main(int ac, char **av)
 {
 	struct sigaction sact;
 	int ret;
-	timer_t timer_id;
-	struct sigevent sevt;
-	struct itimerspec ts;
-	int nprocs, use_sleep, use_busyloop;
+	struct timer_state *st;
+	int nprocs, proc_index;
+	int cpus[CPU_SETSIZE], ncpus;
 	int i, opt, idx;
 	int io_procs, io_count, io_wait, io_bs, io_flush;
-	char *procname, *buf;
+	int mem_procs, net_procs;
+	int *net_fds, *net_ports;
+	struct mem_load ml;
+	struct net_load nl;
+	char *procname;
+	const char *io_dir;
+	struct io_ctx ioc;
+	struct arena_slot *io_slot;
 	size_t procname_len;
-	int proc_index;
 	char filebuf[PATH_MAX];
+	char *analyze_path, *export_path;
+	int iters_set;
 
 	enum {
 		OPT_ITERS	= (1 << 8),
@@ -342,6 +6654,64 @@ int main(int ac, char **av)
 		OPT_IO_WAIT,
 		OPT_IO_FLUSH,
 		OPT_CSV,
+		OPT_HIST_DUMP,
+		OPT_CLOCK,
+		OPT_THREADS,
+		OPT_CPU_LIST,
+		OPT_BACKEND,
+		OPT_AGGREGATE,
+		OPT_RECORD,
+		OPT_RECORD_TICKS,
+		OPT_ANALYZE,
+		OPT_EXPORT,
+		OPT_PCT,
+		OPT_IO_ENGINE,
+		OPT_IO_DEPTH,
+		OPT_IO_PATTERN,
+		OPT_IO_RWMIX,
+		OPT_IO_DIR,
+		OPT_IO_DIRECT,
+		OPT_PERF,
+		OPT_SPIKE_THRESHOLD,
+		OPT_CPU_LOAD,
+		OPT_CPU_LOAD_SIZE,
+		OPT_MEM_PROCS,
+		OPT_MEM_SIZE,
+		OPT_MEM_THP,
+		OPT_MEM_RSS,
+		OPT_MEM_WAIT,
+		OPT_SCHED,
+		OPT_SCHED_PRIO,
+		OPT_SCHED_RUNTIME,
+		OPT_MLOCKALL,
+		OPT_PREFAULT,
+		OPT_DMA_LATENCY,
+		OPT_SWEEP,
+		OPT_SWEEP_TIME,
+		OPT_CONVERGE,
+		OPT_CONVERGE_ERR,
+		OPT_CONVERGE_MAX,
+		OPT_STATS_SOCKET,
+		OPT_BASELINE,
+		OPT_COMPARE,
+		OPT_COMPARE_LATE,
+		OPT_MAX_REGRESS,
+		OPT_MAX_KS,
+		OPT_MAX_AD,
+		OPT_TIMERS_PER_PROC,
+		OPT_TIMER_FREQS,
+		OPT_PHASE,
+		OPT_LAUNCH_FANOUT,
+		OPT_WAKEUP_TEST,
+		OPT_WAKEUP_CPU,
+		OPT_NET_PROCS,
+		OPT_NET_PROTO,
+		OPT_NET_SIZE,
+		OPT_NET_RATE,
+		OPT_NET_REUSEPORT,
+		OPT_NET_BUSY_POLL,
+		OPT_CGROUP,
+		OPT_CGROUP_SET,
 	};
 
 	struct option longopts[] = {
@@ -357,7 +6727,67 @@ int main(int ac, char **av)
 		{ "io-count", required_argument, NULL, OPT_IO_COUNT },
 		{ "io-wait", required_argument, NULL, OPT_IO_WAIT },
 		{ "io-flush", no_argument, NULL, OPT_IO_FLUSH },
+		{ "io-engine", required_argument, NULL, OPT_IO_ENGINE },
+		{ "io-depth", required_argument, NULL, OPT_IO_DEPTH },
+		{ "io-pattern", required_argument, NULL, OPT_IO_PATTERN },
+		{ "io-rwmix", required_argument, NULL, OPT_IO_RWMIX },
+		{ "io-dir", required_argument, NULL, OPT_IO_DIR },
+		{ "io-direct", no_argument, NULL, OPT_IO_DIRECT },
+		{ "perf", no_argument, NULL, OPT_PERF },
+		{ "spike-threshold", required_argument, NULL,
+		    OPT_SPIKE_THRESHOLD },
+		{ "cpu-load", required_argument, NULL, OPT_CPU_LOAD },
+		{ "cpu-load-size", required_argument, NULL, OPT_CPU_LOAD_SIZE },
+		{ "mem-procs", required_argument, NULL, OPT_MEM_PROCS },
+		{ "mem-size", required_argument, NULL, OPT_MEM_SIZE },
+		{ "mem-thp", no_argument, NULL, OPT_MEM_THP },
+		{ "mem-rss", required_argument, NULL, OPT_MEM_RSS },
+		{ "mem-wait", required_argument, NULL, OPT_MEM_WAIT },
+		{ "net-procs", required_argument, NULL, OPT_NET_PROCS },
+		{ "net-proto", required_argument, NULL, OPT_NET_PROTO },
+		{ "net-size", required_argument, NULL, OPT_NET_SIZE },
+		{ "net-rate", required_argument, NULL, OPT_NET_RATE },
+		{ "net-reuseport", no_argument, NULL, OPT_NET_REUSEPORT },
+		{ "net-busy-poll", required_argument, NULL, OPT_NET_BUSY_POLL },
+		{ "cgroup", required_argument, NULL, OPT_CGROUP },
+		{ "cgroup-set", required_argument, NULL, OPT_CGROUP_SET },
+		{ "sched", required_argument, NULL, OPT_SCHED },
+		{ "sched-prio", required_argument, NULL, OPT_SCHED_PRIO },
+		{ "sched-runtime", required_argument, NULL, OPT_SCHED_RUNTIME },
+		{ "mlockall", no_argument, NULL, OPT_MLOCKALL },
+		{ "prefault", no_argument, NULL, OPT_PREFAULT },
+		{ "dma-latency", required_argument, NULL, OPT_DMA_LATENCY },
+		{ "sweep", required_argument, NULL, OPT_SWEEP },
+		{ "sweep-time", required_argument, NULL, OPT_SWEEP_TIME },
+		{ "converge", required_argument, NULL, OPT_CONVERGE },
+		{ "converge-err", required_argument, NULL, OPT_CONVERGE_ERR },
+		{ "converge-max", required_argument, NULL, OPT_CONVERGE_MAX },
+		{ "stats-socket", required_argument, NULL, OPT_STATS_SOCKET },
+		{ "baseline", required_argument, NULL, OPT_BASELINE },
+		{ "compare", required_argument, NULL, OPT_COMPARE },
+		{ "compare-late", no_argument, NULL, OPT_COMPARE_LATE },
+		{ "max-regress", required_argument, NULL, OPT_MAX_REGRESS },
+		{ "max-ks", required_argument, NULL, OPT_MAX_KS },
+		{ "max-ad", required_argument, NULL, OPT_MAX_AD },
+		{ "timers-per-proc", required_argument, NULL,
+		    OPT_TIMERS_PER_PROC },
+		{ "timer-freqs", required_argument, NULL, OPT_TIMER_FREQS },
+		{ "phase", required_argument, NULL, OPT_PHASE },
+		{ "launch-fanout", required_argument, NULL, OPT_LAUNCH_FANOUT },
+		{ "wakeup-test", required_argument, NULL, OPT_WAKEUP_TEST },
+		{ "wakeup-cpu", required_argument, NULL, OPT_WAKEUP_CPU },
 		{ "csv", required_argument, NULL, OPT_CSV },
+		{ "hist-dump", required_argument, NULL, OPT_HIST_DUMP },
+		{ "clock", required_argument, NULL, OPT_CLOCK },
+		{ "threads", no_argument, NULL, OPT_THREADS },
+		{ "cpu-list", required_argument, NULL, OPT_CPU_LIST },
+		{ "backend", required_argument, NULL, OPT_BACKEND },
+		{ "aggregate", no_argument, NULL, OPT_AGGREGATE },
+		{ "record", required_argument, NULL, OPT_RECORD },
+		{ "record-ticks", required_argument, NULL, OPT_RECORD_TICKS },
+		{ "analyze", required_argument, NULL, OPT_ANALYZE },
+		{ "export", required_argument, NULL, OPT_EXPORT },
+		{ "pct", required_argument, NULL, OPT_PCT },
 		{ NULL, 0, NULL, 0}
 	};
 
@@ -369,19 +6799,42 @@ int main(int ac, char **av)
 	yieldpct = 100;
 	nprocs = -1;
 	idx = 0;
-	use_sleep = 0;
+	nbackends = 0;
 	use_busyloop = 1;
 	io_procs = 0;
+	mem_procs = 0;
+	net_procs = 0;
+	memset(&ml, 0, sizeof(ml));
+	memset(&nl, 0, sizeof(nl));
+	nl.size = DFLT_NET_SIZE;
+	ml.size = (size_t)DFLT_MEM_SIZE << 20;
 	io_bs = DFLT_IO_BS;
 	io_count = DFLT_IO_COUNT;
 	io_wait = DFLT_IO_WAIT;
 	io_flush = 0;
+	io_dir = "/tmp";
+	memset(&ioc, 0, sizeof(ioc));
+	ioc.engine = IO_BUFFERED;
+	ioc.depth = 1;
+	ioc.pattern = IO_SEQ;
+	ncpus = 0;
 	tcsv_fd = -1;
 	icsv_fd = -1;
+	acsv_fd = -1;
+	record_ticks = DFLT_RECORD_TICKS;
+	analyze_path = NULL;
+	export_path = NULL;
+	iters_set = 0;
+	memcpy(analyze_pcts, report_pcts, sizeof(report_pcts));
+	nanalyze_pcts = NUM_REPORT_PCTS;
+	sweep_axes[SWEEP_NPROCS].var = &nprocs;
+	sweep_axes[SWEEP_IO_PROCS].var = &io_procs;
+	sweep_axes[SWEEP_MEM_PROCS].var = &mem_procs;
 	while ((opt = getopt_long(ac, av, "", longopts, &idx)) != -1) {
 		switch (opt) {
 		case OPT_ITERS:
 			iters = atoi(optarg);
+			iters_set = 1;
 			break;
 		case OPT_FREQ:
 			timerfreq = atoi(optarg);
@@ -399,7 +6852,8 @@ int main(int ac, char **av)
 
 			break;
 		case OPT_USESLEEP:
-			use_sleep = 1;
+			backends[0] = TICK_SLEEP;
+			nbackends = 1;
 			break;
 		case OPT_NOBUSYLOOP:
 			use_busyloop = 0;
@@ -413,16 +6867,164 @@ int main(int ac, char **av)
 		case OPT_IO_COUNT:
 			io_count = atoi(optarg);
 			break;
-		case OPT_IO_WAIT:
-			io_wait = atoi(optarg);
+		case OPT_IO_WAIT:
+			io_wait = atoi(optarg);
+			break;
+		case OPT_IO_FLUSH:
+			io_flush = 1;
+			break;
+		case OPT_IO_ENGINE:
+			for (i = 0; i < NUM_IO_ENGINE; i++)
+				if (strcmp(optarg, io_engines[i].name) == 0)
+					break;
+			if (i == NUM_IO_ENGINE) {
+				fprintf(stderr, "Unknown I/O engine: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			ioc.engine = i;
+			if (i == IO_DIRECT)
+				ioc.direct = 1;
+			break;
+		case OPT_IO_DEPTH:
+			ioc.depth = atoi(optarg);
+			break;
+		case OPT_IO_PATTERN:
+			if (strcmp(optarg, "seq") == 0)
+				ioc.pattern = IO_SEQ;
+			else if (strcmp(optarg, "rand") == 0)
+				ioc.pattern = IO_RAND;
+			else {
+				fprintf(stderr, "Unknown I/O pattern: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_IO_RWMIX:
+			ioc.rwmix = atoi(optarg);
+			break;
+		case OPT_IO_DIR:
+			io_dir = strdup(optarg);
+			break;
+		case OPT_IO_DIRECT:
+			ioc.direct = 1;
+			break;
+		case OPT_PERF:
+			use_perf = 1;
+			break;
+		case OPT_SCHED:
+			for (i = 0; i < (int)NUM_SCHED_POLICIES; i++)
+				if (strcmp(optarg, sched_policies[i].name) == 0)
+					break;
+			if (i == (int)NUM_SCHED_POLICIES) {
+				fprintf(stderr, "Unknown scheduling policy: "
+				    "%s\n", optarg);
+				usage(av[0]);
+			}
+			sched_pol = i;
+			break;
+		case OPT_SCHED_PRIO:
+			sched_prio = atoi(optarg);
+			break;
+		case OPT_SCHED_RUNTIME:
+			sched_runtime = atoi(optarg);
+			break;
+		case OPT_MLOCKALL:
+			use_mlockall = 1;
+			break;
+		case OPT_PREFAULT:
+			use_prefault = 1;
+			break;
+		case OPT_DMA_LATENCY:
+			dma_latency = atoi(optarg);
+			break;
+		case OPT_MEM_PROCS:
+			mem_procs = atoi(optarg);
+			break;
+		case OPT_MEM_SIZE:
+			ml.size = (size_t)atoi(optarg) << 20;
+			break;
+		case OPT_MEM_THP:
+			ml.thp = 1;
+			break;
+		case OPT_MEM_RSS:
+			ml.rss = (size_t)atoi(optarg) << 20;
+			break;
+		case OPT_MEM_WAIT:
+			ml.wait = atoi(optarg);
+			break;
+		case OPT_NET_PROCS:
+			net_procs = atoi(optarg);
+			break;
+		case OPT_NET_PROTO:
+			if (strcmp(optarg, "tcp") != 0 &&
+			    strcmp(optarg, "udp") != 0) {
+				fprintf(stderr, "Unknown network protocol: "
+				    "%s\n", optarg);
+				usage(av[0]);
+			}
+			nl.tcp = strcmp(optarg, "tcp") == 0;
+			break;
+		case OPT_NET_SIZE:
+			nl.size = atoi(optarg);
+			break;
+		case OPT_NET_RATE:
+			nl.rate = atoi(optarg);
+			break;
+		case OPT_NET_REUSEPORT:
+			nl.reuseport = 1;
+			break;
+		case OPT_NET_BUSY_POLL:
+			nl.busy_poll = atoi(optarg);
+			break;
+		case OPT_CGROUP:
+			/* The procname overwrites argv. */
+			cgroup_root = strdup(optarg);
+			break;
+		case OPT_CGROUP_SET:
+			if (cgroup_parse_setting(optarg) != 0) {
+				fprintf(stderr, "Invalid cgroup setting: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_CPU_LOAD:
+			for (i = 0; i < NUM_LOAD; i++)
+				if (strcmp(optarg, load_kernels[i].name) == 0)
+					break;
+			if (i == NUM_LOAD) {
+				fprintf(stderr, "Unknown CPU load: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			if (!load_supported(i)) {
+				fprintf(stderr, "CPU load %s is not supported "
+				    "on this CPU\n", optarg);
+				exit(1);
+			}
+			cpu_load = i;
 			break;
-		case OPT_IO_FLUSH:
-			io_flush = 1;
+		case OPT_CPU_LOAD_SIZE:
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr, "Invalid CPU load size: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			cpu_load_size = (size_t)atoi(optarg) * 1024;
+			break;
+		case OPT_SPIKE_THRESHOLD:
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr, "Invalid spike threshold: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			spike_threshold = (uint64_t)atoi(optarg) * 1000;
 			break;
 		case OPT_CSV:
 			/*
 			 * Open <optarg>.timer.csv and <optarg>.io.csv
 			 */
+			csv_prefix = strdup(optarg);
 			snprintf(filebuf, sizeof(filebuf), "%s.timer.csv",
 			    optarg);
 			tcsv_fd = open(filebuf,
@@ -445,6 +7047,168 @@ int main(int ac, char **av)
 				exit(1);
 			}
 
+			break;
+		case OPT_HIST_DUMP:
+			/* av[] is overwritten with the process name later. */
+			hist_dump = strdup(optarg);
+			break;
+		case OPT_CLOCK:
+			for (i = 0; i < NUM_CLK; i++)
+				if (strcmp(optarg, clock_srcs[i].name) == 0)
+					break;
+			if (i == NUM_CLK) {
+				fprintf(stderr, "Unknown clock source: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			clock_src = i;
+			break;
+		case OPT_THREADS:
+			use_threads = 1;
+			break;
+		case OPT_CPU_LIST:
+			ncpus = parse_cpu_list(optarg, cpus, CPU_SETSIZE);
+			if (ncpus <= 0) {
+				fprintf(stderr, "Invalid CPU list: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_AGGREGATE:
+			aggregate = 1;
+			break;
+		case OPT_RECORD:
+			record_path = strdup(optarg);
+			break;
+		case OPT_RECORD_TICKS:
+			record_ticks = strtoull(optarg, NULL, 0);
+			if (record_ticks == 0) {
+				fprintf(stderr, "Invalid record size: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_ANALYZE:
+			analyze_path = strdup(optarg);
+			break;
+		case OPT_EXPORT:
+			export_path = strdup(optarg);
+			break;
+		case OPT_PCT:
+			nanalyze_pcts = parse_pct_list(optarg);
+			if (nanalyze_pcts <= 0) {
+				fprintf(stderr, "Invalid percentile list: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_SWEEP:
+			if (sweep_add(optarg) != 0) {
+				fprintf(stderr, "Invalid sweep: %s\n", optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_SWEEP_TIME:
+			sweep_time = atoi(optarg);
+			break;
+		case OPT_CONVERGE:
+			conv.pct = atof(optarg);
+			if (conv.pct <= 0 || conv.pct >= 100) {
+				fprintf(stderr, "Invalid percentile: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_CONVERGE_ERR:
+			conv.err = atof(optarg);
+			break;
+		case OPT_CONVERGE_MAX:
+			conv.max_secs = atoi(optarg);
+			break;
+		case OPT_STATS_SOCKET:
+			if (strlen(optarg) >=
+			    sizeof(((struct sockaddr_un *)0)->sun_path)) {
+				fprintf(stderr, "Socket path too long: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
+			stats_path = strdup(optarg);
+			break;
+		case OPT_BASELINE:
+		case OPT_COMPARE:
+			i = opt == OPT_BASELINE ? CMP_BASE : CMP_NEW;
+			if (ncompare_files[i] == MAX_COMPARE_FILES) {
+				fprintf(stderr, "At most %d files per side\n",
+				    MAX_COMPARE_FILES);
+				usage(av[0]);
+			}
+			compare_files[i][ncompare_files[i]++] = optarg;
+			break;
+		case OPT_COMPARE_LATE:
+			compare_late = 1;
+			break;
+		case OPT_MAX_REGRESS:
+			max_regress = atof(optarg);
+			break;
+		case OPT_MAX_KS:
+			max_ks = atof(optarg);
+			break;
+		case OPT_MAX_AD:
+			max_ad = atof(optarg);
+			break;
+		case OPT_TIMERS_PER_PROC:
+			timers_per_proc = atoi(optarg);
+			break;
+		case OPT_TIMER_FREQS:
+			ntimer_classes = parse_timer_freqs(optarg);
+			if (ntimer_classes <= 0) {
+				fprintf(stderr, "Invalid timer frequencies: "
+				    "%s\n", optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_PHASE:
+			for (i = 0; i < NUM_PHASE; i++)
+				if (strcmp(optarg, phase_names[i]) == 0)
+					break;
+			if (i == NUM_PHASE) {
+				fprintf(stderr, "Unknown phase: %s\n", optarg);
+				usage(av[0]);
+			}
+			launch_phase = i;
+			break;
+		case OPT_LAUNCH_FANOUT:
+			launch_fanout = atoi(optarg);
+			break;
+		case OPT_WAKEUP_TEST:
+			nbackends = parse_backend_list(optarg);
+			for (i = 0; i < nbackends; i++)
+				if (!TICK_IS_WAKEUP(backends[i]))
+					break;
+			if (nbackends <= 0 || i < nbackends) {
+				fprintf(stderr, "Invalid wakeup mechanism "
+				    "list: %s\n", optarg);
+				usage(av[0]);
+			}
+			break;
+		case OPT_WAKEUP_CPU:
+			for (i = 0; i < NUM_WAKE_PLACE; i++)
+				if (strcmp(optarg, wake_places[i]) == 0)
+					break;
+			if (i == NUM_WAKE_PLACE) {
+				fprintf(stderr, "Unknown wakeup placement: "
+				    "%s\n", optarg);
+				usage(av[0]);
+			}
+			wakeup_place = i;
+			break;
+		case OPT_BACKEND:
+			nbackends = parse_backend_list(optarg);
+			if (nbackends <= 0) {
+				fprintf(stderr, "Invalid backend list: %s\n",
+				    optarg);
+				usage(av[0]);
+			}
 			break;
 		default:
 			printf ("Invalid option: %d\n", opt);
@@ -452,16 +7216,145 @@ int main(int ac, char **av)
 		}
 	}
 
-	if (nprocs < 1) {
+	if (analyze_path == NULL && export_path != NULL) {
+		fprintf(stderr, "--export needs --analyze.\n");
+		usage(av[0]);
+	}
+
+	if (analyze_path != NULL && record_path != NULL) {
+		fprintf(stderr, "--record can not be used with --analyze.\n");
+		usage(av[0]);
+	}
+
+	if (conv.pct != 0) {
+		if (conv.err <= 0 || conv.max_secs <= 0) {
+			fprintf(stderr, "Invalid convergence error or "
+			    "time cap\n");
+			usage(av[0]);
+		}
+		if (analyze_path != NULL) {
+			fprintf(stderr, "--converge can not be used with "
+			    "--analyze.\n");
+			usage(av[0]);
+		}
+		/* Batches are the collector's intervals. */
+		aggregate = 1;
+	}
+
+	if (ncompare_files[CMP_BASE] > 0 || ncompare_files[CMP_NEW] > 0) {
+		if (ncompare_files[CMP_BASE] == 0 ||
+		    ncompare_files[CMP_NEW] == 0 || analyze_path != NULL) {
+			fprintf(stderr, "--compare needs --baseline and can "
+			    "not be used with --analyze.\n");
+			usage(av[0]);
+		}
+		if (max_regress < 0 || max_ks < 0 || max_ks > 1 ||
+		    max_ad < 0) {
+			fprintf(stderr, "Invalid comparison threshold\n");
+			usage(av[0]);
+		}
+		return compare_runs();
+	}
+
+	if (stats_path != NULL) {
+		if (analyze_path != NULL) {
+			fprintf(stderr, "--stats-socket can not be used with "
+			    "--analyze.\n");
+			usage(av[0]);
+		}
+		/* The collector serves it. */
+		aggregate = 1;
+	}
+
+	if (sweep_init() != 0) {
+		fprintf(stderr, "Too many sweep cells, at most %d.\n",
+		    SWEEP_MAX_CELLS);
+		usage(av[0]);
+	}
+
+	if (nsweep_cells > 0) {
+		if (analyze_path != NULL || record_path != NULL) {
+			fprintf(stderr, "--sweep can not be used with "
+			    "--analyze or --record.\n");
+			usage(av[0]);
+		}
+		if (sweep_time <= 0) {
+			fprintf(stderr, "Invalid sweep time: %d\n",
+			    sweep_time);
+			usage(av[0]);
+		}
+		/* Cells report through the collector. */
+		aggregate = 1;
+	}
+
+	if (nprocs < 1 && analyze_path == NULL) {
 		fprintf(stderr, "Invalid proc count: %d\n", nprocs);
 		usage(av[0]);
 	}
 
-	if (use_sleep && yieldtime != -1) {
+	if (nbackends == 0) {
+		backends[0] = TICK_SIGNAL;
+		nbackends = 1;
+	}
+
+	for (i = 0; i < nbackends; i++)
+		if (backends[i] == TICK_SLEEP)
+			break;
+	if (i < nbackends && yieldtime != -1) {
 		fprintf(stderr, "Yield time can not be used with sleep mode.\n");
 		usage(av[0]);
 	}
 
+	for (i = 0; i < nbackends; i++)
+		if (backends[i] != TICK_SIGNAL)
+			break;
+	if (cpu_load != -1 && (i < nbackends || !use_busyloop)) {
+		fprintf(stderr, "--cpu-load runs in the busy loop of the "
+		    "signal backend only.\n");
+		usage(av[0]);
+	}
+
+	if (timers_per_proc < 1 ||
+	    (ntimer_classes > 0 && timers_per_proc == 1)) {
+		fprintf(stderr, "Invalid timers per proc: %d (--timer-freqs "
+		    "needs more than one)\n", timers_per_proc);
+		usage(av[0]);
+	}
+
+	if (timers_per_proc > 1) {
+		if (i < nbackends || record_path != NULL ||
+		    analyze_path != NULL) {
+			fprintf(stderr, "--timers-per-proc needs the signal "
+			    "backend and no --record or --analyze.\n");
+			usage(av[0]);
+		}
+		if (ntimer_classes == 0) {
+			timer_class_us[0] = timerfreq;
+			ntimer_classes = 1;
+		}
+	}
+
+	for (i = 0; i < nbackends; i++)
+		if (TICK_IS_WAKEUP(backends[i]))
+			break;
+	if (i < nbackends) {
+		if (record_path != NULL || sched_policies[sched_pol].policy ==
+		    SCHED_DEADLINE) {
+			fprintf(stderr, "Wakeup tests can not be used with "
+			    "--record or --sched deadline.\n");
+			usage(av[0]);
+		}
+		sched_getaffinity(0, sizeof(wakeup_cpus), &wakeup_cpus);
+	} else if (wakeup_place != -1) {
+		fprintf(stderr, "--wakeup-cpu needs --wakeup-test.\n");
+		usage(av[0]);
+	}
+
+	if (launch_fanout < 0) {
+		fprintf(stderr, "Invalid launch fan-out: %d\n", launch_fanout);
+		usage(av[0]);
+	}
+
 	if (yieldpct < 0 || yieldpct > 100) {
 		fprintf(stderr, "Yield percentage value invalid: %d\n",
 		    yieldpct);
@@ -473,11 +7366,62 @@ int main(int ac, char **av)
 		usage(av[0]);
 	}
 
+	if (sched_prio < 1 || sched_prio > 99) {
+		fprintf(stderr, "Invalid scheduling priority: %d\n",
+		    sched_prio);
+		usage(av[0]);
+	}
+
+	if (sched_policies[sched_pol].policy == SCHED_DEADLINE && ncpus > 0) {
+		fprintf(stderr, "--sched deadline can not be combined with "
+		    "--cpu-list.\n");
+		usage(av[0]);
+	}
+
+	if (sched_runtime < 0 || sched_runtime > timerfreq ||
+	    dma_latency < -1) {
+		fprintf(stderr, "Invalid deadline runtime or DMA latency\n");
+		usage(av[0]);
+	}
+
+	if (mem_procs < 0 || ml.size == 0 || ml.wait < 0) {
+		fprintf(stderr, "Invalid memory proc settings\n");
+		usage(av[0]);
+	}
+
+	if (net_procs < 0 || nl.size < (int)sizeof(uint64_t) ||
+	    nl.size > NET_MAX_SIZE || nl.rate < 0 || nl.busy_poll < 0) {
+		fprintf(stderr, "Invalid network proc settings\n");
+		usage(av[0]);
+	}
+
+	if (ncg_settings > 0 && cgroup_root == NULL) {
+		fprintf(stderr, "--cgroup-set needs --cgroup.\n");
+		usage(av[0]);
+	}
+
 	if (io_bs <= 0) {
 		fprintf(stderr, "Invalid I/O blocksize: %d\n", io_bs);
 		usage(av[0]);
 	}
 
+	if (ioc.direct && io_bs % 4096 != 0) {
+		fprintf(stderr, "O_DIRECT needs a 4k multiple blocksize: %d\n",
+		    io_bs);
+		usage(av[0]);
+	}
+
+	if (ioc.depth < 1 || ioc.depth > 4096) {
+		fprintf(stderr, "Invalid I/O depth: %d\n", ioc.depth);
+		usage(av[0]);
+	}
+
+	if (ioc.rwmix < 0 || ioc.rwmix > 100) {
+		fprintf(stderr, "Invalid I/O read percentage: %d\n",
+		    ioc.rwmix);
+		usage(av[0]);
+	}
+
 	if (io_count < 0) {
 		fprintf(stderr, "Invalid I/O count: %d\n", io_count);
 		usage(av[0]);
@@ -494,26 +7438,188 @@ int main(int ac, char **av)
 		return 1;
 	}
 
+	/* Only returns in the process that runs one cell of the sweep. */
+	if (nsweep_cells > 0)
+		sweep_run();
 
 	if (icsv_fd != -1)
-		write_fd(icsv_fd, "t,MBytes,Total_Time,MB/S\n");
+		write_fd(icsv_fd, "t,MBytes,Total_Time,MB/S,"
+		    "IOPS,Lat_P50,Lat_P99,Lat_Max,Sync\n");
 
-	if (tcsv_fd != -1)
-		write_fd(tcsv_fd, "t,Iters,Min,Max,Avg,Dev%,Dev,Steal%\n");
+	if (tcsv_fd != -1) {
+		filebuf[0] = '\0';
+		for (i = 0; use_perf && i < NUM_PERF; i++)
+			snprintf(filebuf + strlen(filebuf),
+			    sizeof(filebuf) - strlen(filebuf), "%s,",
+			    perf_counters[i].col);
+		write_fd(tcsv_fd, "t,Iters,Min,Max,Avg,Dev%%,Dev,%sSteal%%,"
+		    "IRQ%%,SoftIRQ%%,IRQs,SoftIRQs,RQ_Wait,"
+		    "P50,P90,P99,P99.9,P99.99,Lost,"
+		    "Late_P50,Late_P99,Late_P99.9,Late_P99.99,Late_Max,Dropped,"
+		    "Timer,CPU,Backend,Sched,Sched_Prio,Mlockall,Prefault,"
+		    "DMA_Lat%s\n", filebuf,
+		    cpu_load != -1 ? ",Load,Load_Rate" : "");
+	}
+
+	if (mem_procs > 0 && csv_prefix != NULL) {
+		snprintf(filebuf, sizeof(filebuf), "%s.mem.csv", csv_prefix);
+		mcsv_fd = open(filebuf, O_CREAT|O_APPEND|O_WRONLY|O_TRUNC,
+		    S_IRUSR|S_IWUSR);
+		if (mcsv_fd == -1) {
+			fprintf(stderr, "Failed to open: %s\n", filebuf);
+			exit(1);
+		}
+
+		write_fd(mcsv_fd, "t,MBytes,Total_Time,MB/S,Faults/S,Major,"
+		    "Alloc_P50,Alloc_P99,Alloc_Max,Unmap_Max\n");
+	}
+
+	if (net_procs > 0 && csv_prefix != NULL) {
+		snprintf(filebuf, sizeof(filebuf), "%s.net.csv", csv_prefix);
+		ncsv_fd = open(filebuf, O_CREAT|O_APPEND|O_WRONLY|O_TRUNC,
+		    S_IRUSR|S_IWUSR);
+		if (ncsv_fd == -1) {
+			fprintf(stderr, "Failed to open: %s\n", filebuf);
+			exit(1);
+		}
+
+		write_fd(ncsv_fd, "t,Proto,Msgs,Total_Time,PPS,Gbps,"
+		    "Lat_P50,Lat_P99,Lat_Max,Sent,Errors\n");
+	}
+
+	if (cgroup_root != NULL) {
+		cg_used[CG_TIMER] = 1;
+		cg_used[CG_IO] = io_procs > 0;
+		cg_used[CG_MEM] = mem_procs > 0;
+		cg_used[CG_NET] = net_procs > 0;
+		for (i = 0; i < ncg_settings; i++)
+			if (!cg_used[cg_settings[i].cls]) {
+				fprintf(stderr, "No %s procs for --cgroup-set "
+				    "to apply to.\n",
+				    cg_names[cg_settings[i].cls]);
+				usage(av[0]);
+			}
+		cgroup_setup();
+
+		if (csv_prefix != NULL) {
+			snprintf(filebuf, sizeof(filebuf), "%s.cgroup.csv",
+			    csv_prefix);
+			gcsv_fd = open(filebuf,
+			    O_CREAT|O_APPEND|O_WRONLY|O_TRUNC,
+			    S_IRUSR|S_IWUSR);
+			if (gcsv_fd == -1) {
+				fprintf(stderr, "Failed to open: %s\n",
+				    filebuf);
+				exit(1);
+			}
+
+			write_fd(gcsv_fd, "t,Group,CPU_ms,Periods,Throttled,"
+			    "Throttled_ms,CPU_Some%%,CPU_Full%%,IO_Some%%,"
+			    "IO_Full%%,Mem_Some%%,Mem_Full%%\n");
+		}
+	}
+
+	if (spike_threshold != 0 && csv_prefix != NULL) {
+		snprintf(filebuf, sizeof(filebuf), "%s.spike.csv", csv_prefix);
+		scsv_fd = open(filebuf, O_CREAT|O_APPEND|O_WRONLY|O_TRUNC,
+		    S_IRUSR|S_IWUSR);
+		if (scsv_fd == -1) {
+			fprintf(stderr, "Failed to open: %s\n", filebuf);
+			exit(1);
+		}
 
+		write_fd(scsv_fd, "t,Timer,Seq,Gap,Late,CPU,Vol_CS,Invol_CS,"
+		    "Steal%%,IRQ%%,SoftIRQ%%,IRQs,SoftIRQs\n");
+	}
+
+	if (timers_per_proc > 1 && csv_prefix != NULL) {
+		snprintf(filebuf, sizeof(filebuf), "%s.class.csv", csv_prefix);
+		kcsv_fd = open(filebuf, O_CREAT|O_APPEND|O_WRONLY|O_TRUNC,
+		    S_IRUSR|S_IWUSR);
+		if (kcsv_fd == -1) {
+			fprintf(stderr, "Failed to open: %s\n", filebuf);
+			exit(1);
+		}
+
+		write_fd(kcsv_fd, "t,Timer,Class,Freq,Timers,Ticks,"
+		    "P50,P90,P99,P99.9,P99.99,Max,"
+		    "Late_P50,Late_P99,Late_P99.9,Late_P99.99,Late_Max,"
+		    "Dropped,SigQ,SigQ_Max\n");
+	}
+
+	if (analyze_path != NULL)
+		return trace_analyze(analyze_path, iters_set, export_path);
+
+	if (aggregate) {
+		arena = arena_create(nprocs + io_procs + mem_procs +
+		    net_procs);
+		for (i = 0; i < arena->nslots; i++) {
+			if (i < nprocs) {
+				arena->slots[i].kind = SLOT_TIMER;
+				arena->slots[i].index = i;
+			} else if (i < nprocs + io_procs) {
+				arena->slots[i].kind = SLOT_IO;
+				arena->slots[i].index = i - nprocs;
+			} else if (i < nprocs + io_procs + mem_procs) {
+				arena->slots[i].kind = SLOT_MEM;
+				arena->slots[i].index = i - nprocs - io_procs;
+			} else {
+				arena->slots[i].kind = SLOT_NET;
+				arena->slots[i].index = i - nprocs - io_procs -
+				    mem_procs;
+			}
+		}
+
+		if (csv_prefix != NULL) {
+			snprintf(filebuf, sizeof(filebuf), "%s.agg.csv",
+			    csv_prefix);
+			acsv_fd = open(filebuf,
+			    O_CREAT|O_APPEND|O_WRONLY|O_TRUNC,
+			    S_IRUSR|S_IWUSR);
+			if (acsv_fd == -1) {
+				fprintf(stderr, "Failed to open: %s\n",
+				    filebuf);
+				exit(1);
+			}
+
+			write_fd(acsv_fd, "t,Timers,Reports,Ticks,"
+			    "P50,P90,P99,P99.9,P99.99,Max,"
+			    "Late_P50,Late_P99,Late_P99.9,Late_P99.99,Late_Max,"
+			    "Dropped,Lost,Worst\n");
+		}
+	}
+
+	if (spike_threshold != 0)
+		trace_marker_open();
+
+	if (cpu_load == LOAD_LOCK)
+		load_lock_create();
+
+	if (dma_latency != -1)
+		dma_latency_hold();
+
+	clock_calibrate();
+	rt_print();
+	if (timers_per_proc > 1)
+		subtimers_limit(nprocs);
 	prog_start = get_time();
 
-	printf("Spawning %d timer processes...\n", nprocs);
+	printf("Spawning %d timer %s...\n", nprocs,
+	    use_threads ? "threads" : "processes");
 	fflush(stdout);
 
-	/* Fork timer procs. */
-	for (i = 1; i < nprocs; i++) {
-		proc_index = i;
-		int pid = fork();
-		if (pid == -1) {
-			perror("fork");
-			exit(1);
-		} else if (pid == 0)
+	if (launch_phase != -1)
+		launch = launch_create(nprocs);
+	if (launch_fanout > 0 && !use_threads)
+		prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+	/*
+	 * Fork timer procs. With --aggregate the parent is the collector,
+	 * otherwise it is timer #0.
+	 */
+	if (!use_threads) {
+		proc_index = launch_tree(arena != NULL ? 0 : 1, nprocs);
+		if (proc_index != -1)
 			goto timer_proc;
 	}
 
@@ -530,150 +7636,167 @@ int main(int ac, char **av)
 				exit(1);
 			} else if (pid == 0)
 				goto io_proc;
+
+			if (arena != NULL)
+				arena->slots[nprocs + i].pid = pid;
 		}
 	}
 
-	/* Proc index for main process is zero and always a timer. */
-	proc_index = 0;
+	/* Fork memory pressure processes. */
+	if (mem_procs > 0) {
+		printf("Spawning %d memory processes...\n", mem_procs);
+		fflush(stdout);
 
-timer_proc:
-	snprintf(procname, procname_len, "Timer #%d", proc_index);
-	memcpy(av[0], procname, procname_len);
+		for (i = 0; i < mem_procs; i++) {
+			proc_index = i;
+			int pid = fork();
+			if (pid == -1) {
+				perror("fork");
+				exit(1);
+			} else if (pid == 0)
+				goto mem_proc;
 
-	if (!use_sleep) {
-		memset(&sact, 0, sizeof(sact));
+			if (arena != NULL)
+				arena->slots[nprocs + io_procs + i].pid = pid;
+		}
+	}
 
-		sact.sa_sigaction = handle_sig;
-		sigemptyset(&sact.sa_mask);
-		sigaddset(&sact.sa_mask, MYSIG);
-		sact.sa_flags = SA_RESTART|SA_SIGINFO;
+	/*
+	 * Fork network processes. All their sockets are bound first so
+	 * every SO_REUSEPORT receiver is there before any sender starts.
+	 */
+	if (net_procs > 0) {
+		printf("Spawning %d network processes...\n", net_procs);
+		fflush(stdout);
 
-		ret = sigaction(MYSIG, &sact, NULL);
-		if (ret != 0) {
-			perror("sigaction");
+		net_fds = calloc(net_procs, sizeof(*net_fds));
+		net_ports = calloc(net_procs, sizeof(*net_ports));
+		if (net_fds == NULL || net_ports == NULL) {
+			fprintf(stderr, "Failed to allocate memory\n");
 			return 1;
 		}
+		for (i = 0; i < net_procs; i++)
+			net_fds[i] = net_socket(&nl, nl.reuseport && i > 0 ?
+			    net_ports[0] : 0, &net_ports[i]);
 
-		memset(&sevt, 0, sizeof(sevt));
-		sevt.sigev_notify = SIGEV_SIGNAL;
-		sevt.sigev_signo = MYSIG;
-		sevt.sigev_value.sival_int = 0;
+		for (i = 0; i < net_procs; i++) {
+			proc_index = i;
+			int pid = fork();
+			if (pid == -1) {
+				perror("fork");
+				exit(1);
+			} else if (pid == 0)
+				goto net_proc;
 
-		ret = timer_create(CLOCK_REALTIME, &sevt, &timer_id);
-		if (ret != 0) {
-			perror("timer_create");
-			return 1;
+			if (arena != NULL)
+				arena->slots[nprocs + io_procs + mem_procs +
+				    i].pid = pid;
 		}
+		for (i = 0; i < net_procs; i++)
+			close(net_fds[i]);
+	}
 
-		ts.it_value.tv_sec = timerfreq / 1000000;
-		ts.it_value.tv_nsec = (timerfreq % 1000000) * 1000;
+	if (arena != NULL && !use_threads) {
+		snprintf(procname, procname_len, "Collector");
+		memcpy(av[0], procname, procname_len);
 
-		ts.it_interval.tv_sec = ts.it_value.tv_sec;
-		ts.it_interval.tv_nsec = ts.it_value.tv_nsec;
+		return run_collector();
+	}
 
-		timer_settime(timer_id, 0, &ts, NULL);
+	/* Proc index for main process is zero and always a timer. */
+	proc_index = 0;
 
-		/* Work loop. */
-		while (1) {
-			if (!use_busyloop)
-				/* Sleep 60 seconds...this will be interrupted
-				 * by the timer anyways.
-				 */
-				usleep(60000000);
-		}
-	} else {
-		struct timespec freq_ts;
+timer_proc:
+	snprintf(procname, procname_len, "Timer #%d", proc_index);
+	memcpy(av[0], procname, procname_len);
+	cgroup_join(CG_TIMER);
 
-		freq_ts.tv_sec = timerfreq / 1000000;
-		freq_ts.tv_nsec = (timerfreq % 1000000) * 1000;
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
 
-		while (1) {
-			iter_update();
+	/* Only the signal backend uses it, but it costs nothing to set. */
+	memset(&sact, 0, sizeof(sact));
 
-			nanosleep(&freq_ts, NULL);
-		}
+	sact.sa_sigaction = timers_per_proc > 1 ? handle_sig_multi :
+	    handle_sig;
+	sigemptyset(&sact.sa_mask);
+	sigaddset(&sact.sa_mask, MYSIG);
+	sact.sa_flags = SA_RESTART|SA_SIGINFO;
+
+	ret = sigaction(MYSIG, &sact, NULL);
+	if (ret != 0) {
+		perror("sigaction");
+		return 1;
 	}
 
+	if (use_threads)
+		return run_timer_threads(nprocs, cpus, ncpus);
+
+	st = timer_state_alloc(proc_index);
+	if (ncpus > 0)
+		st->cpu = cpus[proc_index % ncpus];
+	st->backend = backends[proc_index % nbackends];
+	if (arena != NULL)
+		st->slot = &arena->slots[proc_index];
+
+	if (timer_run(st) != 0)
+		return 1;
+
+	timer_dump_hists(st);
+
 	return 0;
 
 
 io_proc:
 	snprintf(procname, procname_len, "I/O Load #%d", proc_index);
 	memcpy(av[0], procname, procname_len);
+	cgroup_join(CG_IO);
 
-	buf = malloc(io_bs);
-	if (buf == NULL) {
-		fprintf(stderr, "Failed to allocate I/O buffer\n");
-		exit(1);
+	io_slot = NULL;
+	if (arena != NULL) {
+		io_slot = &arena->slots[nprocs + proc_index];
+		io_slot->pid = getpid();
 	}
 
+	ioc.bs = io_bs;
+	ioc.count = io_count;
+	srandom(getpid());
+	io_open(&ioc, io_dir);
+
 	while (1) {
-		int ifd, ofd, j;
-		uint64_t io_start, io_end;
-		ssize_t rd, wr;
-		char filetmp[] = "/tmp/tmpXXXXXXXXXX";
-		double tot_bytes, tot_us;
-
-		ifd = open("/dev/zero", O_RDONLY);
-		if (ifd == -1) {
-			fprintf(stderr, "Failed to open /dev/zero\n");
-			exit(1);
-		}
+		struct io_report ior;
 
-		ofd = mkstemp(filetmp);
-		if (ofd == -1) {
-			fprintf(stderr, "Failed to open tempfile\n");
-			exit(1);
-		} else
-			unlink(filetmp);
-
-		io_start = get_time();
-		for (j = 0; j < io_count; j++) {
-			rd = readn(ifd, buf, io_bs);
-			if (rd != io_bs) {
-				fprintf(stderr,
-				    "Failed to read from input file");
-				exit(1);
-			}
+		io_pass(&ioc, io_flush, &ior);
+		ior.pid = getpid();
+		ior.index = proc_index;
+		io_report_publish(io_slot, &ior);
 
-			wr = writen(ofd, buf, rd);
-			if (wr != rd) {
-				fprintf(stderr,
-				    "Failed to write to output file");
-				exit(1);
-			}
-		}
+		if (io_wait > 0)
+			usleep(io_wait * 1000000);
+	}
 
-		/* Include the close in the time calc to include time to
-		 * flush the buffer cache.
-		 */
-		if (io_flush)
-			fdatasync(ofd);
-		close(ofd);
-		io_end = get_time();
-
-		close(ifd);
-
-		tot_bytes = (double)io_bs * (double)io_count;
-		tot_us = (double)io_end - (double)io_start;
-		printf("I> P: %d, MBytes: %5.1f, Time (s): %4.1f, MB/s: %5.1f\n",
-		    getpid(),
-		    tot_bytes / 1000000.0,
-		    tot_us / 1000000.0,
-		    tot_bytes / tot_us);
-		fflush(stdout);
+mem_proc:
+	snprintf(procname, procname_len, "Memory Load #%d", proc_index);
+	memcpy(av[0], procname, procname_len);
+	cgroup_join(CG_MEM);
 
-		if (icsv_fd != -1)
-			write_fd(icsv_fd, "%ld,%.1f,%.1f,%.1f\n",
-			    (io_end - prog_start) / 1000000,
-			    tot_bytes / 1000000.0,
-			    tot_us / 1000000.0,
-			    tot_bytes / tot_us);
+	mem_load_run(&ml, proc_index, arena != NULL ?
+	    &arena->slots[nprocs + io_procs + proc_index] : NULL);
 
+	return 0;
 
-		if (io_wait > 0)
-			usleep(io_wait * 1000000);
-	}
+net_proc:
+	snprintf(procname, procname_len, "Net Load #%d", proc_index);
+	memcpy(av[0], procname, procname_len);
+	cgroup_join(CG_NET);
+
+	for (i = 0; i < net_procs; i++)
+		if (i != proc_index)
+			close(net_fds[i]);
+	nl.fd = net_fds[proc_index];
+	nl.port = net_ports[proc_index];
+	net_load_run(&nl, proc_index, arena != NULL ?
+	    &arena->slots[nprocs + io_procs + mem_procs + proc_index] : NULL);
 
 	return 0;
 }